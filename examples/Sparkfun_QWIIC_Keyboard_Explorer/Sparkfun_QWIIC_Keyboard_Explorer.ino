@@ -63,9 +63,9 @@ boolean kbdMode = false;
 // out and, if the class can't handle the types or if the size of something is too big or small Arduino will tell you
 // this when it verifies the program which is better then trying to figure out why your project isn't working after you
 // upload it. For the SwitchMatrixScanner template, we use the parameters (these are the numbers in the brackets <>) to
-// tell C++ to reserve `ROWS * COLS * 4` bytes of memory inside of the scanner object (where `4` is a coefficient inside
-// of the class: the class uses 4 bytes to track the state of a switch). If your target doesn't have that much memory
-// the sketch verification will fail.
+// tell C++ how much memory to reserve inside of the scanner object. The class tracks each row of switches as a few
+// words with one bit per switch so, with the default debounce settings and up to 8 columns, each row takes about 6
+// bytes. If your target doesn't have that much memory the sketch verification will fail.
 //
 // The `gh::thirtytwobits::` prefixes are called "namespaces" and are used to ensure that my class can be used even if
 // you want to use something else call "SwitchMatrixScanner" in your sketch. It uses my Github username which is
@@ -0,0 +1,480 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_ANALOG_SCANNER_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_ANALOG_SCANNER_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Scans a matrix of analog (Hall-effect) switches. Rows are selected exactly as in SwitchMatrixScanner and each
+ * column is an ADC input. Every position is converted to a key travel from 0 (at rest) to 255 (bottomed out)
+ * using a per-key calibration and then compared against per-key actuation and release points, optionally with
+ * rapid trigger. Scancodes, SwitchHandlers, SwitchEvent buffers and SwitchEventRings work the same as for
+ * SwitchMatrixScanner.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixAnalogScanner.h>
+ *
+ *      gh::thirtytwobits::AnalogSwitchMatrixScanner<ROWS, COLS> scanner(rowPins, adcPins);
+ *
+ *      void setup()
+ *      {
+ *          scanner.setup(onKeysDown, onKeysUp);
+ *          scanner.setCalibration(512, 900);    // rest and bottomed-out ADC readings for every key
+ *          scanner.calibrateRest();             // with no keys pressed
+ *          scanner.setThresholds(100, 80, 20);  // actuate at 100, release at 80, rapid trigger 20
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          scanner.scan();
+ *      }
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+// +--------------------------------------------------------------------------+
+// | ANALOG COLUMN READERS
+// +--------------------------------------------------------------------------+
+/**
+ * An analog column reader is given to the AnalogSwitchMatrixScanner as its COLUMNS parameter. It provides:
+ *
+ *      template <size_t COL_COUNT>
+ *      class Reader
+ *      {
+ *      public:
+ *          explicit Reader(const uint8_t (&column_pins)[COL_COUNT]);
+ *          void setup();
+ *          void startConversion();                          // the selected row has settled
+ *          void readColumns(uint16_t (&values)[COL_COUNT]); // waits for the conversions to finish
+ *      };
+ *
+ * The scanner processes the previous row between startConversion and readColumns, so a reader that converts
+ * the whole row with DMA (a scan sequence) and returns from startConversion at once overlaps the conversions
+ * with that work. SamdAdcColumns (in SwitchMatrixSamdAdcColumns.h) does this on SAMD21 boards and scans a frame
+ * of 80 keys in about 0.5 ms.
+ */
+
+/**
+ * Columns read one at a time with analogRead. This is simple and portable but slow: about 100 microseconds per
+ * column on AVR boards and more on SAMD21 with the core's default ADC settings, so a frame of 80 keys takes
+ * 8 ms or longer (125 Hz at best). It can't scan large matrices at 1 kHz.
+ */
+struct AnalogReadColumns
+{
+    template <size_t COL_COUNT>
+    class Reader
+    {
+    public:
+        explicit Reader(const uint8_t (&column_pins)[COL_COUNT])
+            : m_col_pins()
+        {
+            memcpy(m_col_pins, column_pins, sizeof(column_pins));
+        }
+
+        void setup() {}
+
+        void startConversion() {}
+
+        void readColumns(uint16_t (&values)[COL_COUNT])
+        {
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                values[c] = static_cast<uint16_t>(analogRead(m_col_pins[c]));
+            }
+        }
+
+    private:
+        uint8_t m_col_pins[COL_COUNT];
+    };
+};
+
+// +--------------------------------------------------------------------------+
+// | THE ANALOG CLASS :: AnalogSwitchMatrixScanner
+// +--------------------------------------------------------------------------+
+/**
+ * Travel is in 256ths of the calibrated range. A key closes when its travel reaches its actuation point and
+ * opens when it falls to its release point. With a rapid trigger sensitivity a closed key also opens as soon
+ * as it rises that far from the deepest point reached. It then closes again as soon as it is pressed that far
+ * from the shallowest point reached, or at its actuation point once it has come back up to its release point.
+ *
+ * @tparam ROW_COUNT          Number of rows.
+ * @tparam COL_COUNT          Number of ADC columns.
+ * @tparam EVENT_BUFFER_SIZE  The size of the buffers handed to the SwitchHandlers.
+ * @tparam ROWS               A row driver as used by SplitPins (defaults to ArduinoRows).
+ * @tparam COLUMNS            An analog column reader (defaults to AnalogReadColumns).
+ */
+template <size_t ROW_COUNT,
+          size_t COL_COUNT,
+          size_t EVENT_BUFFER_SIZE = 10,
+          typename ROWS            = ArduinoRows,
+          typename COLUMNS         = AnalogReadColumns>
+class AnalogSwitchMatrixScanner final
+{
+public:
+    static_assert(ROW_COUNT * COL_COUNT < 0xFFFF, "Scancodes must fit in ScanCodeType.");
+
+    using SwitchHandler = typename SwitchHandlerQueue<EVENT_BUFFER_SIZE>::SwitchHandler;
+
+    static constexpr size_t  event_buffer_size = EVENT_BUFFER_SIZE;
+    static constexpr size_t  row_count         = ROW_COUNT;
+    static constexpr size_t  col_count         = COL_COUNT;
+    static constexpr uint8_t travel_max        = 255;
+
+    /**
+     * Every key starts calibrated for a 10-bit ADC (rest at 0, bottomed out at 1023) with its actuation point
+     * at half travel, its release point at 40% and rapid trigger off.
+     *
+     * @param  row_pins     Row pins as used by the ROWS driver.
+     * @param  column_pins  ADC pins (or channels) as used by the COLUMNS reader.
+     */
+    AnalogSwitchMatrixScanner(const uint8_t (&row_pins)[ROW_COUNT], const uint8_t (&column_pins)[COL_COUNT])
+        : m_keys()
+        , m_rows(row_pins)
+        , m_columns(column_pins)
+        , m_row_settle_us(0)
+        , m_stats()
+        , m_handler_queue(m_stats)
+    {
+        setCalibration(0, 1023);
+        setThresholds(128, 102, 0);
+    }
+
+    ~AnalogSwitchMatrixScanner() {}
+    AnalogSwitchMatrixScanner(const AnalogSwitchMatrixScanner&)  = delete;
+    AnalogSwitchMatrixScanner(const AnalogSwitchMatrixScanner&&) = delete;
+    AnalogSwitchMatrixScanner& operator=(const AnalogSwitchMatrixScanner&) = delete;
+    AnalogSwitchMatrixScanner& operator=(const AnalogSwitchMatrixScanner&&) = delete;
+
+    /**
+     * Call from within the Arduino setup function. See SwitchMatrixScanner::setup.
+     */
+    void setup(SwitchHandler switchclosed_handler = nullptr, SwitchHandler switchopen_handler = nullptr, void* userdata = nullptr)
+    {
+        m_handler_queue.setHandlers(switchclosed_handler, switchopen_handler, userdata);
+        m_rows.setup();
+        m_columns.setup();
+    }
+
+    /**
+     * Scans the matrix and invokes the SwitchHandlers.
+     *
+     * @return true if anything changed else false.
+     */
+    bool scan()
+    {
+        SetupHandlers               handlers(m_handler_queue);
+        CallbackSink<SetupHandlers> sink(m_handler_queue, handlers);
+        return scanMatrix(sink);
+    }
+
+    /**
+     * Scans the matrix and pushes events into the given ring. See SwitchMatrixScanner::scan.
+     */
+    template <size_t RING_CAPACITY>
+    bool scan(SwitchEventRing<RING_CAPACITY>& ring)
+    {
+        SwitchEventRingSink<RING_CAPACITY> sink(ring);
+        return scanMatrix(sink);
+    }
+
+    /**
+     * Scans the matrix and writes its events into the given buffer. See SwitchMatrixScanner::scan.
+     *
+     * @return The number of events written.
+     */
+    size_t scan(SwitchEvent* const events, const size_t max_events)
+    {
+        SwitchEventBufferSink sink(events, max_events);
+        scanMatrix(sink);
+        return sink.length();
+    }
+
+    /**
+     * Sets the ADC readings for a key at rest and bottomed out. bottom may be above or below rest depending on
+     * the magnet's polarity. A scancode of 0 sets every key.
+     */
+    void setCalibration(const ScanCodeType scancode, const uint16_t rest, const uint16_t bottom)
+    {
+        size_t first;
+        size_t last;
+        if (keyRange(scancode, first, last))
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                m_keys[i].calibrate(rest, bottom);
+            }
+        }
+    }
+
+    void setCalibration(const uint16_t rest, const uint16_t bottom)
+    {
+        setCalibration(0, rest, bottom);
+    }
+
+    /**
+     * Reads every key once and makes that reading its rest point, keeping its calibrated range. Call this with
+     * no keys pressed, for example from setup().
+     */
+    void calibrateRest()
+    {
+        uint16_t values[COL_COUNT];
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            readRow(r, values);
+            m_rows.releaseRow(r);
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                Key&          key    = m_keys[r * COL_COUNT + c];
+                const int32_t span   = static_cast<int32_t>(key.bottom) - static_cast<int32_t>(key.rest);
+                int32_t       bottom = static_cast<int32_t>(values[c]) + span;
+                bottom               = (bottom < 0) ? 0 : ((bottom > 0xFFFF) ? 0xFFFF : bottom);
+                key.calibrate(values[c], static_cast<uint16_t>(bottom));
+            }
+        }
+    }
+
+    /**
+     * Sets the actuation and release points (in travel units) and the rapid trigger sensitivity (0 for off)
+     * for a key. release must be below actuation. A scancode of 0 sets every key.
+     */
+    void setThresholds(const ScanCodeType scancode,
+                       const uint8_t      actuation,
+                       const uint8_t      release,
+                       const uint8_t      rapid_trigger_sensitivity)
+    {
+        size_t first;
+        size_t last;
+        if (keyRange(scancode, first, last))
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                m_keys[i].actuation   = actuation;
+                m_keys[i].release     = release;
+                m_keys[i].sensitivity = rapid_trigger_sensitivity;
+            }
+        }
+    }
+
+    void setThresholds(const uint8_t actuation, const uint8_t release, const uint8_t rapid_trigger_sensitivity)
+    {
+        setThresholds(0, actuation, release, rapid_trigger_sensitivity);
+    }
+
+    /**
+     * Sets the minimum time between selecting a row and starting its conversions (0 by default). Use this if
+     * the sensors are powered by their row and need time to start up.
+     */
+    void setRowSettleTime(const uint16_t microseconds)
+    {
+        m_row_settle_us = microseconds;
+    }
+
+    /**
+     * Key travel from the last scan, from 0 (at rest) to travel_max (bottomed out).
+     */
+    uint8_t getTravel(const ScanCodeType scancode) const
+    {
+        const Key* const key = keyAt(scancode);
+        return (key != nullptr) ? key->travel : 0;
+    }
+
+    bool isSwitchClosed(ScanCodeType scancode) const
+    {
+        const Key* const key = keyAt(scancode);
+        return (key != nullptr) && key->closed;
+    }
+
+private:
+    // +----------------------------------------------------------------------+
+    // | KEYS
+    // +----------------------------------------------------------------------+
+    struct Key
+    {
+        void calibrate(const uint16_t new_rest, const uint16_t new_bottom)
+        {
+            rest   = new_rest;
+            bottom = new_bottom;
+            span   = static_cast<uint16_t>((bottom > rest) ? bottom - rest : rest - bottom);
+            // 16.16 fixed point so converting a reading is a multiply and a shift.
+            scale = (span > 0) ? (static_cast<uint32_t>(travel_max) << 16) / span : 0;
+        }
+
+        uint8_t toTravel(const uint16_t value) const
+        {
+            const uint16_t distance = (bottom > rest) ? ((value > rest) ? value - rest : 0)
+                                                      : ((value < rest) ? rest - value : 0);
+            if (distance >= span)
+            {
+                return (span > 0) ? travel_max : 0;
+            }
+            // distance < span so the product is less than travel_max << 16.
+            return static_cast<uint8_t>((distance * scale) >> 16);
+        }
+
+        /*
+         * The state the key should be in at its current travel.
+         */
+        bool shouldClose() const
+        {
+            if (closed)
+            {
+                return !(travel <= release || (sensitivity > 0 && travel + sensitivity <= extreme));
+            }
+            if (sensitivity > 0 && extreme > release)
+            {
+                // Released by rapid trigger and not yet back to the release point.
+                return (travel >= extreme + sensitivity);
+            }
+            return (travel >= actuation);
+        }
+
+        uint16_t rest;
+        uint16_t bottom;
+        uint16_t span;
+        uint32_t scale;
+        uint8_t  actuation;
+        uint8_t  release;
+        uint8_t  sensitivity;
+        uint8_t  travel;
+        // The deepest travel since closing or the shallowest since opening.
+        uint8_t extreme;
+        bool    closed;
+    };
+
+    static constexpr const size_t KeyCount = ROW_COUNT * COL_COUNT;
+
+    /*
+     * The keys a setter applies to: every key for scancode 0, else just the one.
+     */
+    static bool keyRange(const ScanCodeType scancode, size_t& first, size_t& last)
+    {
+        if (scancode > KeyCount)
+        {
+            return false;
+        }
+        first = (scancode == 0) ? 0 : scancode - 1;
+        last  = (scancode == 0) ? KeyCount : scancode;
+        return true;
+    }
+
+    const Key* keyAt(const ScanCodeType scancode) const
+    {
+        return (scancode == 0 || scancode > KeyCount) ? nullptr : &m_keys[scancode - 1];
+    }
+
+    // +----------------------------------------------------------------------+
+    // | SCANNING
+    // +----------------------------------------------------------------------+
+    void readRow(const size_t row, uint16_t (&values)[COL_COUNT])
+    {
+        m_rows.selectRow(row);
+        settle();
+        m_columns.startConversion();
+        m_columns.readColumns(values);
+    }
+
+    void settle() const
+    {
+        if (m_row_settle_us > 0)
+        {
+            const uint32_t selected_at = static_cast<uint32_t>(micros());
+            while (static_cast<uint32_t>(micros()) - selected_at < m_row_settle_us)
+            {
+            }
+        }
+    }
+
+    template <typename Sink>
+    bool scanMatrix(Sink& sink)
+    {
+        bool     found_changes = false;
+        uint16_t values[COL_COUNT];
+        m_rows.selectRow(0);
+        settle();
+        m_columns.startConversion();
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            m_columns.readColumns(values);
+            if (r + 1 < ROW_COUNT)
+            {
+                // Start the next row so its conversions run while this row is processed.
+                advance_row(m_rows, r, r + 1);
+                settle();
+                m_columns.startConversion();
+            }
+            else
+            {
+                m_rows.releaseRow(r);
+            }
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                Key& key   = m_keys[r * COL_COUNT + c];
+                key.travel = key.toTravel(values[c]);
+                if (key.shouldClose() == key.closed)
+                {
+                    key.extreme = key.closed ? ((key.travel > key.extreme) ? key.travel : key.extreme)
+                                             : ((key.travel < key.extreme) ? key.travel : key.extreme);
+                    continue;
+                }
+                if (sink.room() == 0)
+                {
+                    // Reported by a later scan.
+                    continue;
+                }
+                key.closed    = !key.closed;
+                key.extreme   = key.travel;
+                found_changes = true;
+                sink.push(static_cast<ScanCodeType>(r * COL_COUNT + c + 1),
+                          key.closed ? SwitchEdge::CLOSED : SwitchEdge::OPENED);
+            }
+        }
+        sink.finish();
+        return found_changes;
+    }
+
+    using RowDriver     = typename ROWS::template Driver<ROW_COUNT>;
+    using ColumnReader  = typename COLUMNS::template Reader<COL_COUNT>;
+    using HandlerQueue  = SwitchHandlerQueue<EVENT_BUFFER_SIZE>;
+    using SetupHandlers = typename HandlerQueue::SetupHandlers;
+
+    template <typename HANDLERS>
+    using CallbackSink = typename HandlerQueue::template Sink<HANDLERS>;
+
+    Key          m_keys[KeyCount];
+    RowDriver    m_rows;
+    ColumnReader m_columns;
+    uint16_t     m_row_settle_us;
+    NoScanStats  m_stats;
+    HandlerQueue m_handler_queue;
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_ANALOG_SCANNER_H
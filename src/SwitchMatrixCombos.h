@@ -0,0 +1,483 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_COMBOS_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_COMBOS_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Detects combos (chords): sets of switches pressed together within a time window that act as one extra key.
+ * ComboDetector compares the scanner's closed bitmap against the previous scan's to get the switches that
+ * closed and opened as row masks, so a scan where nothing changed costs one compare per row. The detector keeps
+ * a bitset for every switch of the combos it is part of and ANDs them as combo switches close, so the combos
+ * that could still match are known without walking the table. That costs ROW_COUNT * COL_COUNT bitsets of
+ * MAX_COMBOS bits of RAM (160 bytes for 80 switches and the default 16 combos).
+ *
+ * Results are delivered through the same batched SwitchHandler signature as the scanner. Switches that aren't
+ * part of a combo pass straight through with their own scancodes. Combo i of the table is reported as
+ * scancode ROW_COUNT * COL_COUNT + i + 1, closed when its last switch closes within the window and opened when
+ * the first of its switches opens. Combo switches are held back until they either complete a combo or can't,
+ * at which point they are reported in the order they closed.
+ *
+ * Example:
+ *
+ *      using Combos = gh::thirtytwobits::ComboDetector<ROWS, COLS>;
+ *
+ *      // scancode ROWS * COLS + 1 for 1 and 2 together, ROWS * COLS + 2 for 13, 14 and 15.
+ *      constexpr Combos::Combo comboTable[] = {Combos::combo(1, 2), Combos::combo(13, 14, 15)};
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS> scanner(rowPins, colPins);
+ *      Combos                                             combos(comboTable, 2, 50000);  // 50 ms window
+ *
+ *      void setup()
+ *      {
+ *          scanner.setup();
+ *          combos.setup(onKeyDown, onKeyUp);
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          scanner.scan();
+ *          combos.update(scanner);
+ *      }
+ *
+ * A combo whose switches are all part of a bigger combo waits in case the bigger one completes. It fires when
+ * the window runs out, when one of its switches is released (so a quick tap still fires it) or when a switch
+ * that isn't part of the bigger combo closes.
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+// +--------------------------------------------------------------------------+
+// | INTERNAL STUFF (you can ignore this)
+// +--------------------------------------------------------------------------+
+namespace
+{
+/*
+ * The bits in row of the given 1-based scancodes.
+ */
+template <size_t COL_COUNT, typename RowMask>
+constexpr RowMask combo_row(size_t)
+{
+    return 0;
+}
+
+template <size_t COL_COUNT, typename RowMask, typename... REST>
+constexpr RowMask combo_row(const size_t row, const ScanCodeType first, const REST... rest)
+{
+    return static_cast<RowMask>(((static_cast<size_t>(first - 1) / COL_COUNT == row)
+                                     ? column_bit<RowMask>(static_cast<size_t>(first - 1) % COL_COUNT)
+                                     : static_cast<RowMask>(0)) |
+                                combo_row<COL_COUNT, RowMask>(row, rest...));
+}
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | ComboDetector
+// +--------------------------------------------------------------------------+
+/**
+ * @tparam ROW_COUNT          Must match the scanner.
+ * @tparam COL_COUNT          Must match the scanner.
+ * @tparam EVENT_BUFFER_SIZE  Scancodes per handler call, as for SwitchMatrixScanner.
+ * @tparam CLOCK              Microsecond clock for the combo window. See TimedDebounce.
+ * @tparam MAX_COMBOS         The largest combo table the detector can use, at most 255.
+ */
+template <size_t ROW_COUNT,
+          size_t COL_COUNT,
+          size_t EVENT_BUFFER_SIZE = 10,
+          typename CLOCK           = MicrosClock,
+          size_t MAX_COMBOS        = 16>
+class ComboDetector final
+{
+public:
+    using RowMask   = typename RowMaskTraits<COL_COUNT>::type;
+    using ComboMask = typename RowMaskTraits<MAX_COMBOS>::type;
+    using SwitchHandler =
+        void (*)(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], size_t scancodes_len, void* userdata);
+
+    static_assert(COL_COUNT <= 64, "Combo tables are built from integer row masks.");
+    static_assert(ROW_COUNT * COL_COUNT + 255 < 0xFFFF, "Combo scancodes must fit in ScanCodeType.");
+    static_assert(EVENT_BUFFER_SIZE > 0, "EVENT_BUFFER_SIZE cannot be 0");
+    static_assert(MAX_COMBOS > 0 && MAX_COMBOS <= 255, "MAX_COMBOS must be between 1 and 255.");
+
+    static constexpr size_t event_buffer_size = EVENT_BUFFER_SIZE;
+
+    /**
+     * One entry of a combo table. Build them with combo().
+     */
+    struct Combo
+    {
+        RowMask keys[ROW_COUNT];
+    };
+
+    /**
+     * A combo of the given scancodes. Usable in constant expressions.
+     */
+    template <typename... SCANCODES>
+    static constexpr Combo combo(const SCANCODES... scancodes)
+    {
+        return make_combo(typename MakeIndices<ROW_COUNT>::type(), scancodes...);
+    }
+
+    /**
+     * The scancode that entry index of the combo table is reported as.
+     */
+    static constexpr ScanCodeType comboScancode(const size_t index)
+    {
+        return static_cast<ScanCodeType>(ROW_COUNT * COL_COUNT + index + 1);
+    }
+
+    /**
+     * @param  combos      The combo table. It is only read here so it needn't outlive the detector.
+     * @param  combos_len  Number of combos in the table. Entries past MAX_COMBOS are ignored.
+     * @param  window_us   How long after the first switch of a combo closes the rest may follow.
+     */
+    ComboDetector(const Combo* const combos, const uint8_t combos_len, const uint32_t window_us)
+        : m_window_us(window_us)
+        , m_window_start(0)
+        , m_switchhandler_closed(nullptr)
+        , m_switchhandler_open(nullptr)
+        , m_switchhandler_userdata(nullptr)
+        , m_previous()
+        , m_switch_combos()
+        , m_combo_sizes{0}
+        , m_candidates(0)
+        , m_pending()
+        , m_consumed()
+        , m_pending_keys{0}
+        , m_closed_buffer{0}
+        , m_open_buffer{0}
+        , m_closed_len(0)
+        , m_open_len(0)
+        , m_pending_len(0)
+        , m_active{0}
+        , m_active_len(0)
+    {
+        const size_t used = (combos_len < MAX_COMBOS) ? combos_len : MAX_COMBOS;
+        for (size_t i = 0; i < used; ++i)
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                for (RowMask keys = combos[i].keys[r]; keys != 0; keys = clear_lowest_column(keys))
+                {
+                    ComboMask& of_switch = m_switch_combos[r * COL_COUNT + lowest_column(keys)];
+                    of_switch            = static_cast<ComboMask>(of_switch | column_bit<ComboMask>(i));
+                    ++m_combo_sizes[i];
+                }
+            }
+        }
+    }
+
+    ComboDetector(const ComboDetector&)  = delete;
+    ComboDetector(const ComboDetector&&) = delete;
+    ComboDetector& operator=(const ComboDetector&) = delete;
+    ComboDetector& operator=(const ComboDetector&&) = delete;
+
+    /**
+     * The handlers receive switch and combo scancodes the way SwitchMatrixScanner's handlers receive switch
+     * scancodes.
+     */
+    void setup(SwitchHandler switchclosed_handler, SwitchHandler switchopen_handler = nullptr, void* userdata = nullptr)
+    {
+        m_switchhandler_closed   = switchclosed_handler;
+        m_switchhandler_open     = switchopen_handler;
+        m_switchhandler_userdata = userdata;
+    }
+
+    /**
+     * Call after every scan. Works out what changed since the last call and calls the handlers.
+     *
+     * @return true if any events were delivered.
+     */
+    template <typename SCANNER>
+    bool update(const SCANNER& scanner)
+    {
+        static_assert(SCANNER::row_count == ROW_COUNT && SCANNER::col_count == COL_COUNT,
+                      "The detector must match the scanner's dimensions.");
+        RowMask closed[ROW_COUNT];
+        scanner.getClosedBitmap(closed);
+        const uint32_t now     = CLOCK::now();
+        bool           changed = false;
+        // Openings first so a switch released and pressed again between calls can't complete a combo alone.
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            if (closed[r] == m_previous[r])
+            {
+                continue;
+            }
+            changed = true;
+            for (RowMask opened = static_cast<RowMask>(m_previous[r] & ~closed[r]); opened != 0;
+                 opened         = clear_lowest_column(opened))
+            {
+                onOpened(r, lowest_column(opened));
+            }
+        }
+        // A window that ran out before this call ends the combo before anything that closed since can join it.
+        expireWindow(now);
+        if (changed)
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                for (RowMask closing = static_cast<RowMask>(closed[r] & ~m_previous[r]); closing != 0;
+                     closing         = clear_lowest_column(closing))
+                {
+                    onClosed(r, lowest_column(closing), now);
+                }
+                m_previous[r] = closed[r];
+            }
+        }
+        expireWindow(now);
+        const bool delivered = (m_closed_len > 0 || m_open_len > 0);
+        flushClosed();
+        flushOpen();
+        return delivered;
+    }
+
+    /**
+     * True while combo index is held.
+     */
+    bool isComboActive(const size_t index) const
+    {
+        for (uint8_t i = 0; i < m_active_len; ++i)
+        {
+            if (m_active[i] == index)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Switches held back at once. More than this and they are reported as they are.
+    static constexpr const uint8_t MaxPending = 8;
+    // Combos held at once.
+    static constexpr const uint8_t MaxActive = 4;
+
+    template <size_t... I, typename... SCANCODES>
+    static constexpr Combo make_combo(Indices<I...>, const SCANCODES... scancodes)
+    {
+        return Combo{{combo_row<COL_COUNT, RowMask>(I, static_cast<ScanCodeType>(scancodes)...)...}};
+    }
+
+    static ScanCodeType scancode_of(const size_t row, const size_t column)
+    {
+        return static_cast<ScanCodeType>(row * COL_COUNT + column + 1);
+    }
+
+    void expireWindow(const uint32_t now)
+    {
+        if (m_pending_len > 0 && now - m_window_start >= m_window_us)
+        {
+            resolvePending();
+        }
+    }
+
+    void onOpened(const size_t row, const size_t column)
+    {
+        const RowMask bit = column_bit<RowMask>(column);
+        if ((m_pending[row] & bit) != 0)
+        {
+            // Released before anything else closed so nothing bigger can complete.
+            resolvePending();
+        }
+        if ((m_consumed[row] & bit) == 0)
+        {
+            queue(m_open_buffer, m_open_len, scancode_of(row, column), false);
+            return;
+        }
+        m_consumed[row] = static_cast<RowMask>(m_consumed[row] & ~bit);
+        uint8_t kept    = 0;
+        for (uint8_t i = 0; i < m_active_len; ++i)
+        {
+            if ((m_switch_combos[row * COL_COUNT + column] & column_bit<ComboMask>(m_active[i])) != 0)
+            {
+                queue(m_open_buffer, m_open_len, comboScancode(m_active[i]), false);
+            }
+            else
+            {
+                m_active[kept++] = m_active[i];
+            }
+        }
+        m_active_len = kept;
+    }
+
+    void onClosed(const size_t row, const size_t column, const uint32_t now)
+    {
+        const RowMask   bit    = column_bit<RowMask>(column);
+        const ComboMask combos = m_switch_combos[row * COL_COUNT + column];
+        if (combos == 0)
+        {
+            // Combos are made of switches held together, so anything else ends the one being built.
+            resolvePending();
+            queue(m_closed_buffer, m_closed_len, scancode_of(row, column), true);
+            return;
+        }
+        if (m_pending_len == MaxPending)
+        {
+            resolvePending();
+        }
+        if (m_pending_len == 0)
+        {
+            m_window_start = now;
+            m_candidates   = combos;
+        }
+        else
+        {
+            m_candidates = static_cast<ComboMask>(m_candidates & combos);
+        }
+        m_pending[row]                  = static_cast<RowMask>(m_pending[row] | bit);
+        m_pending_keys[m_pending_len++] = scancode_of(row, column);
+        bool larger                     = false;
+        match(larger);
+        if (!larger)
+        {
+            // Either a complete combo that nothing bigger could follow, or no combo at all.
+            resolvePending();
+        }
+    }
+
+    /*
+     * The combo whose switches are exactly the pending ones, or -1. larger is set if the pending switches are
+     * part of some bigger combo. Every candidate contains all the pending switches so it is an exact match if
+     * it has as many switches as are pending.
+     */
+    int match(bool& larger) const
+    {
+        int exact = -1;
+        larger    = false;
+        for (ComboMask candidates = m_candidates; candidates != 0; candidates = clear_lowest_column(candidates))
+        {
+            const uint8_t i = lowest_column(candidates);
+            if (m_combo_sizes[i] != m_pending_len)
+            {
+                larger = true;
+            }
+            else if (exact < 0)
+            {
+                exact = i;
+            }
+        }
+        return exact;
+    }
+
+    /*
+     * Settles the pending switches once no more can join them (the window closed, one of them opened, some
+     * other switch closed or no bigger combo contains them): they fire the combo they make up or, failing
+     * that, are reported as themselves.
+     */
+    void resolvePending()
+    {
+        if (m_pending_len == 0)
+        {
+            return;
+        }
+        bool      larger = false;
+        const int exact  = match(larger);
+        if (exact >= 0 && m_active_len < MaxActive)
+        {
+            m_active[m_active_len++] = static_cast<uint8_t>(exact);
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                m_consumed[r] = static_cast<RowMask>(m_consumed[r] | m_pending[r]);
+            }
+            queue(m_closed_buffer, m_closed_len, comboScancode(static_cast<size_t>(exact)), true);
+        }
+        else
+        {
+            for (uint8_t i = 0; i < m_pending_len; ++i)
+            {
+                queue(m_closed_buffer, m_closed_len, m_pending_keys[i], true);
+            }
+        }
+        memset(m_pending, 0, sizeof(m_pending));
+        m_pending_len = 0;
+    }
+
+    void queue(ScanCodeType (&buffer)[EVENT_BUFFER_SIZE], size_t& len, const ScanCodeType scancode, const bool closed)
+    {
+        if (len == EVENT_BUFFER_SIZE)
+        {
+            if (closed)
+            {
+                flushClosed();
+            }
+            else
+            {
+                flushOpen();
+            }
+        }
+        buffer[len++] = scancode;
+    }
+
+    void flushClosed()
+    {
+        if (m_closed_len > 0 && m_switchhandler_closed != nullptr)
+        {
+            m_switchhandler_closed(m_closed_buffer, m_closed_len, m_switchhandler_userdata);
+        }
+        m_closed_len = 0;
+    }
+
+    void flushOpen()
+    {
+        if (m_open_len > 0 && m_switchhandler_open != nullptr)
+        {
+            m_switchhandler_open(m_open_buffer, m_open_len, m_switchhandler_userdata);
+        }
+        m_open_len = 0;
+    }
+
+    uint32_t      m_window_us;
+    uint32_t      m_window_start;
+    SwitchHandler m_switchhandler_closed;
+    SwitchHandler m_switchhandler_open;
+    void*         m_switchhandler_userdata;
+    RowMask       m_previous[ROW_COUNT];
+    // The combos each switch, by scancode - 1, is part of and how many switches each combo has.
+    ComboMask     m_switch_combos[ROW_COUNT * COL_COUNT];
+    uint8_t       m_combo_sizes[MAX_COMBOS];
+    // The combos that contain every pending switch.
+    ComboMask     m_candidates;
+    // Combo switches held back while the window is open, and switches used up by an active combo.
+    RowMask       m_pending[ROW_COUNT];
+    RowMask       m_consumed[ROW_COUNT];
+    // The pending switches in the order they closed.
+    ScanCodeType  m_pending_keys[MaxPending];
+    ScanCodeType  m_closed_buffer[EVENT_BUFFER_SIZE];
+    ScanCodeType  m_open_buffer[EVENT_BUFFER_SIZE];
+    size_t        m_closed_len;
+    size_t        m_open_len;
+    uint8_t       m_pending_len;
+    // Indices of the combos being held.
+    uint8_t       m_active[MaxActive];
+    uint8_t       m_active_len;
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_COMBOS_H
@@ -0,0 +1,397 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_HID_REPORT_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_HID_REPORT_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Builds USB HID keyboard reports from SwitchMatrixScanner events. The report is updated in place from each
+ * scan's events so a sketch can send at most one report per scan, and only when it changed.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixHidReport.h>
+ *      #include <Keyboard.h>
+ *
+ *      // One HID usage per scancode (0 for none). See the USB HID Usage Tables, "Keyboard/Keypad Page".
+ *      const uint8_t keymap[ROWS * COLS] PROGMEM = {0x1E, 0x1F, 0x20, ...};
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS> scanner(rowPins, colPins);
+ *      gh::thirtytwobits::HidKeyboardReportBuilder<>       report(keymap, ROWS * COLS);
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::SwitchEvent events[8];
+ *          const size_t events_len = scanner.scan(events, 8);
+ *          if (report.update(events, events_len))
+ *          {
+ *              // The Arduino Keyboard library's descriptor uses report id 2 for a boot-format report.
+ *              HID().SendReport(2, &report.report(), sizeof(report.report()));
+ *          }
+ *      }
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+// +--------------------------------------------------------------------------+
+// | INTERNAL STUFF (you can ignore this)
+// +--------------------------------------------------------------------------+
+namespace
+{
+constexpr uint8_t HidUsageNone          = 0x00;
+constexpr uint8_t HidUsageErrorRollOver = 0x01;
+constexpr uint8_t HidUsageModifierFirst = 0xE0;
+constexpr uint8_t HidUsageModifierLast  = 0xE7;
+
+inline bool is_modifier_usage(const uint8_t usage)
+{
+    return (usage >= HidUsageModifierFirst && usage <= HidUsageModifierLast);
+}
+
+inline uint8_t modifier_bit(const uint8_t usage)
+{
+    return static_cast<uint8_t>(1U << (usage - HidUsageModifierFirst));
+}
+
+/*
+ * Keymaps live in flash on AVR where they have to be read with pgm_read_byte.
+ */
+inline uint8_t read_keymap(const uint8_t* const keymap, const size_t index)
+{
+#if defined(pgm_read_byte)
+    return pgm_read_byte(keymap + index);
+#else
+    return keymap[index];
+#endif
+}
+
+/*
+ * Sets (or clears) bit usage of a little-endian bitmap. Returns true if the bit changed.
+ */
+inline bool set_usage_bit(uint8_t* const bitmap, const uint8_t usage, const bool set)
+{
+    uint8_t&      byte = bitmap[usage >> 3];
+    const uint8_t bit  = static_cast<uint8_t>(1U << (usage & 7));
+    const uint8_t was  = byte;
+    byte               = set ? static_cast<uint8_t>(byte | bit) : static_cast<uint8_t>(byte & ~bit);
+    return (byte != was);
+}
+
+inline bool usage_bit(const uint8_t* const bitmap, const uint8_t usage)
+{
+    return ((bitmap[usage >> 3] >> (usage & 7)) & 1) != 0;
+}
+
+// Usages below the modifiers. Modifiers have their own byte in every report.
+constexpr size_t HidKeyBitmapBytes = HidUsageModifierFirst / 8;
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | ROLLOVER MODES
+// +--------------------------------------------------------------------------+
+/**
+ * A rollover mode tells HidKeyboardReportBuilder how to lay out its report. A mode provides:
+ *
+ *      struct Report;                   // the bytes sent to the host
+ *      bool     press(uint8_t usage);   // true if the report changed
+ *      bool     release(uint8_t usage); // true if the report changed
+ *      void     clear();
+ *      uint8_t& modifiers();            // the report's modifier byte
+ *      const Report& report() const;
+ *
+ * Usages are never 0 or a modifier when press and release are called.
+ */
+
+/**
+ * The boot protocol report every host understands: a modifier byte and six key slots. Keys stay in the slot
+ * they were pressed into. With more than six keys held every slot reports ErrorRollOver until enough are
+ * released.
+ */
+class SixKeyRollover
+{
+public:
+    struct Report
+    {
+        uint8_t modifiers;
+        uint8_t reserved;
+        uint8_t keys[6];
+    };
+
+    SixKeyRollover()
+        : m_report()
+        , m_held()
+        , m_held_count(0)
+    {}
+
+    bool press(const uint8_t usage)
+    {
+        if (!set_usage_bit(m_held, usage, true))
+        {
+            return false;
+        }
+        ++m_held_count;
+        if (m_held_count > SlotCount)
+        {
+            if (m_held_count == SlotCount + 1)
+            {
+                memset(m_report.keys, HidUsageErrorRollOver, sizeof(m_report.keys));
+                return true;
+            }
+            return false;
+        }
+        set_slot(HidUsageNone, usage);
+        return true;
+    }
+
+    bool release(const uint8_t usage)
+    {
+        if (!set_usage_bit(m_held, usage, false))
+        {
+            return false;
+        }
+        --m_held_count;
+        if (m_held_count == SlotCount)
+        {
+            // Leaving rollover. The held keys take the slots in usage order.
+            memset(m_report.keys, HidUsageNone, sizeof(m_report.keys));
+            size_t used = 0;
+            for (uint8_t held = 1; used < SlotCount && held < HidUsageModifierFirst; ++held)
+            {
+                if (usage_bit(m_held, held))
+                {
+                    m_report.keys[used++] = held;
+                }
+            }
+            return true;
+        }
+        if (m_held_count > SlotCount)
+        {
+            return false;
+        }
+        set_slot(usage, HidUsageNone);
+        return true;
+    }
+
+    void clear()
+    {
+        m_report = Report();
+        memset(m_held, 0, sizeof(m_held));
+        m_held_count = 0;
+    }
+
+    uint8_t& modifiers()
+    {
+        return m_report.modifiers;
+    }
+
+    const Report& report() const
+    {
+        return m_report;
+    }
+
+private:
+    static constexpr size_t SlotCount = sizeof(Report::keys);
+
+    /*
+     * Replaces the first slot holding from with to.
+     */
+    void set_slot(const uint8_t from, const uint8_t to)
+    {
+        for (size_t i = 0; i < SlotCount; ++i)
+        {
+            if (m_report.keys[i] == from)
+            {
+                m_report.keys[i] = to;
+                return;
+            }
+        }
+    }
+
+    Report  m_report;
+    uint8_t m_held[HidKeyBitmapBytes];
+    size_t  m_held_count;
+};
+
+/**
+ * N-key rollover: a modifier byte followed by one bit for every usage below the modifiers. The host must be
+ * given a matching report descriptor (an Input report of 224 one-bit usages from 0x00 to 0xDF).
+ */
+class NKeyRollover
+{
+public:
+    struct Report
+    {
+        uint8_t modifiers;
+        uint8_t keys[HidKeyBitmapBytes];
+    };
+
+    NKeyRollover()
+        : m_report()
+    {}
+
+    bool press(const uint8_t usage)
+    {
+        return set_usage_bit(m_report.keys, usage, true);
+    }
+
+    bool release(const uint8_t usage)
+    {
+        return set_usage_bit(m_report.keys, usage, false);
+    }
+
+    void clear()
+    {
+        m_report = Report();
+    }
+
+    uint8_t& modifiers()
+    {
+        return m_report.modifiers;
+    }
+
+    const Report& report() const
+    {
+        return m_report;
+    }
+
+private:
+    Report m_report;
+};
+
+// +--------------------------------------------------------------------------+
+// | THE MAIN CLASS :: HidKeyboardReportBuilder
+// +--------------------------------------------------------------------------+
+/**
+ * Keeps a HID keyboard report in step with switch events. ROLLOVER is SixKeyRollover (the default) or
+ * NKeyRollover.
+ *
+ * The keymap has one HID usage per scancode (keymap[scancode - 1]). On AVR it must be in PROGMEM. Usage 0
+ * means the switch sends nothing and usages 0xE0 to 0xE7 set the modifier bits. If two switches map to the
+ * same usage, releasing either releases it.
+ */
+template <typename ROLLOVER = SixKeyRollover>
+class HidKeyboardReportBuilder final
+{
+public:
+    using Report = typename ROLLOVER::Report;
+
+    /**
+     * @param  keymap      HID usage for each scancode, in PROGMEM on AVR.
+     * @param  keymap_len  Number of entries in keymap. Scancodes past the end are ignored.
+     */
+    HidKeyboardReportBuilder(const uint8_t* const keymap, const size_t keymap_len)
+        : m_keymap(keymap)
+        , m_keymap_len(keymap_len)
+        , m_rollover()
+    {}
+
+    HidKeyboardReportBuilder(const HidKeyboardReportBuilder&)  = delete;
+    HidKeyboardReportBuilder(const HidKeyboardReportBuilder&&) = delete;
+    HidKeyboardReportBuilder& operator=(const HidKeyboardReportBuilder&) = delete;
+    HidKeyboardReportBuilder& operator=(const HidKeyboardReportBuilder&&) = delete;
+
+    /**
+     * Applies one scan's worth of events.
+     *
+     * @return true if the report changed and should be sent.
+     */
+    bool update(const SwitchEvent* const events, const size_t events_len)
+    {
+        bool changed = false;
+        for (size_t i = 0; i < events_len; ++i)
+        {
+            changed = apply(events[i].scancode, events[i].edge == SwitchEdge::CLOSED) || changed;
+        }
+        return changed;
+    }
+
+    /**
+     * For the SwitchHandler callbacks. Returns true if the report changed.
+     */
+    bool press(const ScanCodeType scancode)
+    {
+        return apply(scancode, true);
+    }
+
+    bool release(const ScanCodeType scancode)
+    {
+        return apply(scancode, false);
+    }
+
+    /**
+     * Releases everything.
+     */
+    void clear()
+    {
+        m_rollover.clear();
+    }
+
+    /**
+     * The report to send to the host.
+     */
+    const Report& report() const
+    {
+        return m_rollover.report();
+    }
+
+private:
+    bool apply(const ScanCodeType scancode, const bool closed)
+    {
+        if (scancode == 0 || scancode > m_keymap_len)
+        {
+            return false;
+        }
+        const uint8_t usage = read_keymap(m_keymap, scancode - 1);
+        if (usage == HidUsageNone)
+        {
+            return false;
+        }
+        if (is_modifier_usage(usage))
+        {
+            uint8_t&      modifiers = m_rollover.modifiers();
+            const uint8_t was       = modifiers;
+            modifiers               = closed ? static_cast<uint8_t>(modifiers | modifier_bit(usage))
+                                             : static_cast<uint8_t>(modifiers & ~modifier_bit(usage));
+            return (modifiers != was);
+        }
+        if (usage > HidUsageModifierLast)
+        {
+            return false;
+        }
+        return closed ? m_rollover.press(usage) : m_rollover.release(usage);
+    }
+
+    const uint8_t* const m_keymap;
+    const size_t         m_keymap_len;
+    ROLLOVER             m_rollover;
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_HID_REPORT_H
@@ -0,0 +1,164 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_MCP23017_COLUMNS_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_MCP23017_COLUMNS_H
+
+#include <Wire.h>
+#include "SwitchMatrixScanner.h"
+
+namespace gh
+{
+namespace thirtytwobits
+{
+/**
+ * Reads columns from an MCP23017 I2C I/O expander. Use it as the COLUMNS half of SplitPins. The column "pins"
+ * are expander pins: 0 to 7 are GPA0 to GPA7 and 8 to 15 are GPB0 to GPB7. Each readColumns is one I2C
+ * transaction that reads GPIOA, or GPIOA and GPIOB together if any column is on port B. Pullups are enabled
+ * in the expander when the scanner is constructed with enable_pullups.
+ *
+ * The expander's interrupt output isn't used so canWakeFromSleep is false. Idle mode still works by
+ * polling.
+ *
+ * Call Wire.begin() before SwitchMatrixScanner::setup.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixMcp23017Columns.h>
+ *
+ *      using Pins = gh::thirtytwobits::SplitPins<gh::thirtytwobits::ArduinoRows,
+ *                                                gh::thirtytwobits::Mcp23017Columns<0x20>>;
+ *
+ *      const byte colInputs[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, 16, 10, Pins> scanner(rowPins, colInputs);
+ *
+ * @tparam ADDRESS  The expander's 7-bit I2C address (0x20 to 0x27).
+ */
+template <uint8_t ADDRESS = 0x20>
+struct Mcp23017Columns
+{
+    template <size_t COL_COUNT, typename RowMask>
+    class Reader
+    {
+    public:
+        static_assert(COL_COUNT <= 16, "An MCP23017 has 16 inputs.");
+
+        explicit Reader(const uint8_t (&column_pins)[COL_COUNT])
+            : m_col_pins()
+            , m_read_bytes(1)
+            , m_identity(true)
+        {
+            memcpy(m_col_pins, column_pins, sizeof(column_pins));
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                m_read_bytes = (m_col_pins[c] >= 8) ? 2 : m_read_bytes;
+                m_identity   = m_identity && (m_col_pins[c] == c);
+            }
+        }
+
+        void setup(const uint8_t column_input_type)
+        {
+            uint16_t inputs = 0;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                inputs = static_cast<uint16_t>(inputs | (1U << m_col_pins[c]));
+            }
+            // IOCON.BANK is 0 after reset so the A and B registers are interleaved and auto-increment. IODIR
+            // isn't written: every pin is an input after reset and the other pins may be in use as outputs. Only
+            // the column bits of GPPU are changed for the same reason.
+            const uint16_t others  = static_cast<uint16_t>(readRegisterPair(RegisterGPPUA) & ~inputs);
+            const uint16_t pullups = (column_input_type == INPUT_PULLUP) ? inputs : 0;
+            writeRegisterPair(RegisterGPPUA, static_cast<uint16_t>(others | pullups));
+        }
+
+        bool armWake(void (*)())
+        {
+            return false;
+        }
+
+        void disarmWake() {}
+
+        RowMask readColumns() const
+        {
+            Wire.beginTransmission(ADDRESS);
+            Wire.write(RegisterGPIOA);
+            Wire.endTransmission(false);
+            Wire.requestFrom(ADDRESS, m_read_bytes);
+            uint16_t port = static_cast<uint16_t>(Wire.read());
+            if (m_read_bytes > 1)
+            {
+                port = static_cast<uint16_t>(port | (static_cast<uint16_t>(Wire.read()) << 8));
+            }
+            // Pressed switches read LOW.
+            const uint16_t low = static_cast<uint16_t>(~port);
+            if (m_identity)
+            {
+                return static_cast<RowMask>(low & column_mask<RowMask>(COL_COUNT));
+            }
+            RowMask sample = 0;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                if ((low >> m_col_pins[c]) & 1)
+                {
+                    sample |= column_bit<RowMask>(c);
+                }
+            }
+            return sample;
+        }
+
+    private:
+        static constexpr const uint8_t RegisterGPPUA = 0x0C;
+        static constexpr const uint8_t RegisterGPIOA = 0x12;
+
+        static uint16_t readRegisterPair(const uint8_t reg)
+        {
+            Wire.beginTransmission(ADDRESS);
+            Wire.write(reg);
+            Wire.endTransmission(false);
+            Wire.requestFrom(ADDRESS, static_cast<uint8_t>(2));
+            const uint16_t low = static_cast<uint16_t>(Wire.read());
+            return static_cast<uint16_t>(low | (static_cast<uint16_t>(Wire.read()) << 8));
+        }
+
+        static void writeRegisterPair(const uint8_t reg, const uint16_t value)
+        {
+            Wire.beginTransmission(ADDRESS);
+            Wire.write(reg);
+            Wire.write(static_cast<uint8_t>(value & 0xFF));
+            Wire.write(static_cast<uint8_t>(value >> 8));
+            Wire.endTransmission();
+        }
+
+        uint8_t m_col_pins[COL_COUNT];
+        uint8_t m_read_bytes;
+        // True if column c is expander pin c so the port value can be used as is.
+        bool m_identity;
+    };
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_MCP23017_COLUMNS_H
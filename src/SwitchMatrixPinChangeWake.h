@@ -0,0 +1,97 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_PIN_CHANGE_WAKE_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_PIN_CHANGE_WAKE_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Pin change interrupts for idle mode on AVR boards. attachInterrupt only reaches the external interrupt pins
+ * (INT0 and INT1 on an Uno, INT0 to INT3 and INT6 on a 32U4) so most column pins can't wake the MCU and
+ * canWakeFromSleep is false. With this header included the scanner arms a pin change interrupt on every other
+ * column pin that has one. Only include this header from one file since it defines the PCINT interrupt
+ * vectors.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixPinChangeWake.h>
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS> scanner(rowPins, colPins);
+ *
+ *      void setup()
+ *      {
+ *          scanner.setup();
+ *          scanner.setIdleModeEnabled(true);
+ *      }
+ *
+ * This conflicts with other users of the PCINT vectors (for example the SoftwareSerial library).
+ */
+#if defined(__AVR__) && defined(digitalPinToPCICR)
+
+#    if defined(PCINT0_vect)
+ISR(PCINT0_vect)
+{
+    gh::thirtytwobits::PinChangeWake::dispatch(0);
+}
+#    endif
+#    if defined(PCINT1_vect)
+ISR(PCINT1_vect)
+{
+    gh::thirtytwobits::PinChangeWake::dispatch(1);
+}
+#    endif
+#    if defined(PCINT2_vect)
+ISR(PCINT2_vect)
+{
+    gh::thirtytwobits::PinChangeWake::dispatch(2);
+}
+#    endif
+#    if defined(PCINT3_vect)
+ISR(PCINT3_vect)
+{
+    gh::thirtytwobits::PinChangeWake::dispatch(3);
+}
+#    endif
+
+namespace
+{
+/*
+ * Tells the scanners the vectors exist before setup() runs.
+ */
+struct SwitchMatrixPinChangeWakeInstaller
+{
+    SwitchMatrixPinChangeWakeInstaller()
+    {
+        gh::thirtytwobits::PinChangeWake::installed() = true;
+    }
+};
+
+SwitchMatrixPinChangeWakeInstaller switch_matrix_pin_change_wake_installer;
+};  // namespace
+
+#endif  // defined(__AVR__) && defined(digitalPinToPCICR)
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_PIN_CHANGE_WAKE_H
@@ -0,0 +1,231 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_SAMD_ADC_COLUMNS_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_SAMD_ADC_COLUMNS_H
+
+#include "SwitchMatrixAnalogScanner.h"
+
+/**
+ * An analog column reader for SAMD21 boards that converts a whole row with the ADC and the DMA controller. Use
+ * it as the COLUMNS parameter of AnalogSwitchMatrixScanner. startConversion starts an input scan of every
+ * column in free-running mode and returns at once, a DMA channel copies each result into a buffer, and
+ * readColumns waits for the last one. The ADC is clocked at 1.5 MHz with a short sampling time so each column
+ * takes about 6 microseconds and, since the conversions overlap with processing the previous row, a frame of
+ * 80 keys takes about 0.5 ms.
+ *
+ * The input scan needs the columns on consecutive ADC channels (AIN0, AIN1, ...) in column order. If they
+ * aren't then readColumns converts each column in turn, which blocks but is still about 6 microseconds per
+ * column.
+ *
+ * Readings are 10 bits, the same as analogRead. The reader takes over the ADC so don't use analogRead while it
+ * is in use. If the DMA controller is already enabled by another library (call setup() after that library's
+ * begin) this reader uses its descriptor table, otherwise it enables the controller with its own.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixSamdAdcColumns.h>
+ *
+ *      const byte adcPins[COLS] = {A0, A1, A2, A3, A4};
+ *      gh::thirtytwobits::AnalogSwitchMatrixScanner<ROWS,
+ *                                                   COLS,
+ *                                                   10,
+ *                                                   gh::thirtytwobits::ArduinoRows,
+ *                                                   gh::thirtytwobits::SamdAdcColumns<>>
+ *          scanner(rowPins, adcPins);
+ *
+ * @tparam DMA_CHANNEL  The DMA channel used to copy the results. It must not be used by anything else.
+ */
+#if defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+
+#    include "wiring_private.h"
+
+namespace gh
+{
+namespace thirtytwobits
+{
+template <uint8_t DMA_CHANNEL = 0>
+struct SamdAdcColumns
+{
+    static_assert(DMA_CHANNEL < DMAC_CH_NUM, "The SAMD21 has 12 DMA channels.");
+
+    template <size_t COL_COUNT>
+    class Reader
+    {
+    public:
+        explicit Reader(const uint8_t (&column_pins)[COL_COUNT])
+            : m_col_pins()
+            , m_channels()
+            , m_results()
+            , m_scan(false)
+        {
+            memcpy(m_col_pins, column_pins, sizeof(column_pins));
+        }
+
+        void setup()
+        {
+            m_scan = true;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                pinPeripheral(m_col_pins[c], PIO_ANALOG);
+                m_channels[c] = static_cast<uint8_t>(g_APinDescription[m_col_pins[c]].ulADCChannelNumber);
+                m_scan        = m_scan && (m_channels[c] == m_channels[0] + c);
+            }
+
+            ADC->CTRLA.bit.ENABLE = 0;
+            sync();
+            // 48 MHz / 32 is within the 2.1 MHz limit. Free running keeps the input scan going without a
+            // software trigger per column.
+            ADC->CTRLB.reg = static_cast<uint16_t>(ADC_CTRLB_PRESCALER_DIV32 | ADC_CTRLB_RESSEL_10BIT |
+                                                   (m_scan ? ADC_CTRLB_FREERUN : 0));
+            sync();
+            ADC->AVGCTRL.reg  = ADC_AVGCTRL_SAMPLENUM_1 | ADC_AVGCTRL_ADJRES(0);
+            ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(3);
+            sync();
+
+            if (m_scan)
+            {
+                setupDma();
+            }
+        }
+
+        void startConversion()
+        {
+            if (!m_scan)
+            {
+                return;
+            }
+            // Disabling stops the previous free-running scan and lets the new one start at the first column.
+            ADC->CTRLA.bit.ENABLE = 0;
+            sync();
+            ADC->INPUTCTRL.reg = ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND |
+                                 ADC_INPUTCTRL_MUXPOS(m_channels[0]) | ADC_INPUTCTRL_INPUTSCAN(COL_COUNT - 1) |
+                                 ADC_INPUTCTRL_INPUTOFFSET(0);
+            sync();
+            ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+
+            DMAC->CHID.reg      = DMAC_CHID_ID(DMA_CHANNEL);
+            DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR;
+            DMAC->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+
+            ADC->CTRLA.bit.ENABLE = 1;
+            sync();
+            ADC->SWTRIG.reg = ADC_SWTRIG_START;
+        }
+
+        void readColumns(uint16_t (&values)[COL_COUNT])
+        {
+            if (m_scan)
+            {
+                DMAC->CHID.reg = DMAC_CHID_ID(DMA_CHANNEL);
+                while (!(DMAC->CHINTFLAG.reg & (DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR)))
+                {
+                }
+                ADC->CTRLA.bit.ENABLE = 0;
+                sync();
+                for (size_t c = 0; c < COL_COUNT; ++c)
+                {
+                    values[c] = m_results[c];
+                }
+                return;
+            }
+            ADC->CTRLA.bit.ENABLE = 1;
+            sync();
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                ADC->INPUTCTRL.reg =
+                    ADC_INPUTCTRL_GAIN_DIV2 | ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_MUXPOS(m_channels[c]);
+                sync();
+                ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+                ADC->SWTRIG.reg  = ADC_SWTRIG_START;
+                while (!(ADC->INTFLAG.reg & ADC_INTFLAG_RESRDY))
+                {
+                }
+                values[c] = static_cast<uint16_t>(ADC->RESULT.reg);
+            }
+            ADC->CTRLA.bit.ENABLE = 0;
+            sync();
+        }
+
+    private:
+        static void sync()
+        {
+            while (ADC->STATUS.bit.SYNCBUSY)
+            {
+            }
+        }
+
+        void setupDma()
+        {
+            PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+            PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+            if (!(DMAC->CTRL.reg & DMAC_CTRL_DMAENABLE))
+            {
+                DMAC->BASEADDR.reg = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(s_descriptors));
+                DMAC->WRBADDR.reg  = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(s_writeback));
+                DMAC->CTRL.reg     = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+            }
+
+            DMAC->CHID.reg = DMAC_CHID_ID(DMA_CHANNEL);
+            DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+            DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+            while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST)
+            {
+            }
+            DMAC->CHCTRLB.reg =
+                DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) | DMAC_CHCTRLB_TRIGACT_BEAT;
+
+            // One halfword per result. With DSTINC the destination address is the end of the buffer.
+            DmacDescriptor& descriptor = reinterpret_cast<DmacDescriptor*>(DMAC->BASEADDR.reg)[DMA_CHANNEL];
+            descriptor.BTCTRL.reg      = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC;
+            descriptor.BTCNT.reg       = static_cast<uint16_t>(COL_COUNT);
+            descriptor.SRCADDR.reg     = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&ADC->RESULT.reg));
+            descriptor.DSTADDR.reg     = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&m_results[COL_COUNT]));
+            descriptor.DESCADDR.reg    = 0;
+        }
+
+        uint8_t           m_col_pins[COL_COUNT];
+        uint8_t           m_channels[COL_COUNT];
+        volatile uint16_t m_results[COL_COUNT];
+        bool              m_scan;
+    };
+
+private:
+    alignas(16) static DmacDescriptor s_descriptors[DMA_CHANNEL + 1];
+    alignas(16) static DmacDescriptor s_writeback[DMA_CHANNEL + 1];
+};
+
+template <uint8_t DMA_CHANNEL>
+alignas(16) DmacDescriptor SamdAdcColumns<DMA_CHANNEL>::s_descriptors[DMA_CHANNEL + 1];
+
+template <uint8_t DMA_CHANNEL>
+alignas(16) DmacDescriptor SamdAdcColumns<DMA_CHANNEL>::s_writeback[DMA_CHANNEL + 1];
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_SAMD_ADC_COLUMNS_H
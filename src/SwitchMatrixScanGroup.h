@@ -0,0 +1,270 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_GROUP_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_GROUP_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Scans several independent matrices together. Rows are interleaved: one row of each matrix in turn, with
+ * every matrix's next row left driven (see SwitchMatrixScanner::setSliceLookahead) so it settles while the
+ * other matrices are read. All events go into one batch tagged with the index of the matrix they came from.
+ *
+ * The matrices must not share row or column pins. Since a matrix's next row stays driven while the other matrices
+ * are read, a column pin shared with another matrix would also see that row's closed switches. Once grouped, only
+ * scan them through the group.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<5, 12> keys(keyRows, keyCols);
+ *      gh::thirtytwobits::SwitchMatrixScanner<1, 4>  encoders(encoderRows, encoderCols);
+ *      gh::thirtytwobits::SwitchMatrixScanner<1, 8>  dips(dipRows, dipCols);
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanGroup<decltype(keys), decltype(encoders), decltype(dips)> group(
+ *          keys, encoders, dips);
+ *
+ *      void setup()
+ *      {
+ *          keys.setup();
+ *          encoders.setup();
+ *          dips.setup();
+ *          group.setScanDivider(2, 50);  // the DIP switches only need a look every 50 scans
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::GroupSwitchEvent events[16];
+ *          const size_t events_len = group.scan(events, 16);
+ *          for (size_t i = 0; i < events_len; ++i)
+ *          {
+ *              // events[i].matrix, events[i].scancode, events[i].edge
+ *          }
+ *      }
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+/**
+ * A switch state change in one of a group's matrices.
+ */
+struct GroupSwitchEvent
+{
+    // The matrix's position in the group's template arguments.
+    uint8_t      matrix;
+    ScanCodeType scancode;
+    SwitchEdge   edge;
+};
+
+// +--------------------------------------------------------------------------+
+// | INTERNAL STUFF (you can ignore this)
+// +--------------------------------------------------------------------------+
+namespace
+{
+/*
+ * C++11 stand-in for a tuple of scanner references that can be walked with a functor.
+ */
+template <size_t INDEX, typename... SCANNERS>
+struct ScanGroupMembers
+{
+    template <typename FUNCTOR>
+    void forEach(FUNCTOR&)
+    {}
+};
+
+template <size_t INDEX, typename FIRST, typename... REST>
+struct ScanGroupMembers<INDEX, FIRST, REST...> : ScanGroupMembers<INDEX + 1, REST...>
+{
+    explicit ScanGroupMembers(FIRST& first, REST&... rest)
+        : ScanGroupMembers<INDEX + 1, REST...>(rest...)
+        , scanner(first)
+    {}
+
+    template <typename FUNCTOR>
+    void forEach(FUNCTOR& functor)
+    {
+        functor(INDEX, scanner);
+        ScanGroupMembers<INDEX + 1, REST...>::forEach(functor);
+    }
+
+    FIRST& scanner;
+};
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | SwitchMatrixScanGroup
+// +--------------------------------------------------------------------------+
+/**
+ * @tparam SCANNERS  The SwitchMatrixScanner types of the group's matrices, in matrix index order.
+ */
+template <typename... SCANNERS>
+class SwitchMatrixScanGroup final
+{
+public:
+    static constexpr size_t matrix_count = sizeof...(SCANNERS);
+
+    static_assert(matrix_count > 0, "A scan group needs at least one matrix.");
+    static_assert(matrix_count <= 255, "Matrix indices are one byte.");
+
+    explicit SwitchMatrixScanGroup(SCANNERS&... scanners)
+        : m_members(scanners...)
+        , m_dividers()
+        , m_countdowns()
+    {
+        for (size_t i = 0; i < matrix_count; ++i)
+        {
+            m_dividers[i] = 1;
+        }
+        Lookahead lookahead;
+        m_members.forEach(lookahead);
+    }
+
+    SwitchMatrixScanGroup(const SwitchMatrixScanGroup&)  = delete;
+    SwitchMatrixScanGroup(const SwitchMatrixScanGroup&&) = delete;
+    SwitchMatrixScanGroup& operator=(const SwitchMatrixScanGroup&) = delete;
+    SwitchMatrixScanGroup& operator=(const SwitchMatrixScanGroup&&) = delete;
+
+    /**
+     * Scans a matrix only once in every divider calls to scan (1, the default, is every call). The adaptive
+     * scan rate and idle mode of each scanner still apply to the scans it gets.
+     */
+    void setScanDivider(const size_t matrix, const uint8_t divider)
+    {
+        if (matrix < matrix_count)
+        {
+            m_dividers[matrix]   = (divider > 0) ? divider : 1;
+            m_countdowns[matrix] = 0;
+        }
+    }
+
+    /**
+     * Scans a frame of every matrix that is due and writes their events into the given buffer in the order
+     * they were found. As with SwitchMatrixScanner::scan, changes that don't fit are left uncommitted and are
+     * reported by a later scan.
+     *
+     * @return The number of events written.
+     */
+    size_t scan(GroupSwitchEvent* const events, const size_t max_events)
+    {
+        bool pending[matrix_count];
+        for (size_t i = 0; i < matrix_count; ++i)
+        {
+            pending[i] = (m_countdowns[i] == 0);
+            m_countdowns[i] =
+                pending[i] ? static_cast<uint8_t>(m_dividers[i] - 1) : static_cast<uint8_t>(m_countdowns[i] - 1);
+        }
+        RowStep step{Sink(events, max_events), pending, true};
+        while (step.any_pending)
+        {
+            step.any_pending = false;
+            m_members.forEach(step);
+        }
+        return step.sink.length();
+    }
+
+private:
+    /*
+     * Writes one matrix's events into the shared batch.
+     */
+    class Sink
+    {
+    public:
+        Sink(GroupSwitchEvent* const events, const size_t max_events)
+            : m_events(events)
+            , m_max_events(max_events)
+            , m_length(0)
+            , m_matrix(0)
+        {}
+
+        size_t room() const
+        {
+            return m_max_events - m_length;
+        }
+
+        void push(const ScanCodeType scancode, const SwitchEdge edge)
+        {
+            m_events[m_length++] = GroupSwitchEvent{m_matrix, scancode, edge};
+        }
+
+        void finish() {}
+
+        size_t length() const
+        {
+            return m_length;
+        }
+
+        void setMatrix(const size_t matrix)
+        {
+            m_matrix = static_cast<uint8_t>(matrix);
+        }
+
+    private:
+        GroupSwitchEvent* const m_events;
+        const size_t            m_max_events;
+        size_t                  m_length;
+        uint8_t                 m_matrix;
+    };
+
+    /*
+     * Scans the next row of every matrix with rows left in this frame.
+     */
+    struct RowStep
+    {
+        template <typename SCANNER>
+        void operator()(const size_t matrix, SCANNER& scanner)
+        {
+            if (!pending[matrix])
+            {
+                return;
+            }
+            sink.setMatrix(matrix);
+            pending[matrix] = !scanner.scanRowsInto(1, sink);
+            any_pending     = any_pending || pending[matrix];
+        }
+
+        Sink sink;
+        bool (&pending)[matrix_count];
+        bool any_pending;
+    };
+
+    struct Lookahead
+    {
+        template <typename SCANNER>
+        void operator()(size_t, SCANNER& scanner)
+        {
+            scanner.setSliceLookahead(true);
+        }
+    };
+
+    ScanGroupMembers<0, SCANNERS...> m_members;
+    uint8_t                          m_dividers[matrix_count];
+    // Calls left before each matrix is scanned again.
+    uint8_t                          m_countdowns[matrix_count];
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_GROUP_H
@@ -0,0 +1,209 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_TIMER_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * Hardware timer support for scanning a SwitchMatrixScanner from an interrupt at a fixed rate. This is
+ * supported on AVR (Timer1) and SAMD21 (TC3) boards. Only include this header from one file since it defines
+ * the timer interrupt vector.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixScanTimer.h>
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS> scanner(rowPins, colPins);
+ *      gh::thirtytwobits::SwitchEventRing<16>             events;
+ *
+ *      SWITCH_MATRIX_SCAN_TIMER_ISR()
+ *      {
+ *          scanner.scan(events);
+ *      }
+ *
+ *      void setup()
+ *      {
+ *          scanner.setup();
+ *          gh::thirtytwobits::SwitchMatrixScanTimer::begin(1000);  // scan at 1 kHz
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::SwitchEvent batch[8];
+ *          const size_t batch_len = events.poll(batch, 8);
+ *          for (size_t i = 0; i < batch_len; ++i)
+ *          {
+ *              // batch[i].scancode, batch[i].edge
+ *          }
+ *      }
+ *
+ * On AVR this conflicts with other users of Timer1 (for example the Servo library).
+ */
+#if defined(__AVR__) || (defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__))
+
+namespace gh
+{
+namespace thirtytwobits
+{
+class SwitchMatrixScanTimer final
+{
+public:
+    SwitchMatrixScanTimer() = delete;
+
+    /**
+     * Starts the timer interrupt.
+     *
+     * @param  rate_hz  How many times per second the SWITCH_MATRIX_SCAN_TIMER_ISR body runs.
+     * @return false if the rate can't be generated from the CPU clock.
+     */
+    static bool begin(const uint32_t rate_hz)
+    {
+        if (rate_hz == 0)
+        {
+            return false;
+        }
+#    if defined(__AVR__)
+        static const uint16_t prescalers[]      = {1, 8, 64, 256, 1024};
+        static const uint8_t  prescaler_bits[] = {_BV(CS10), _BV(CS11), _BV(CS11) | _BV(CS10), _BV(CS12), _BV(CS12) | _BV(CS10)};
+        for (uint8_t i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); ++i)
+        {
+            const uint32_t ticks = F_CPU / (static_cast<uint32_t>(prescalers[i]) * rate_hz);
+            if (ticks > 0 && ticks <= 0x10000UL)
+            {
+                const uint8_t oldSREG = SREG;
+                cli();
+                TCCR1A = 0;
+                TCCR1B = 0;
+                TCNT1  = 0;
+                OCR1A  = static_cast<uint16_t>(ticks - 1);
+                // CTC mode with OCR1A as TOP.
+                TCCR1B = _BV(WGM12) | prescaler_bits[i];
+                TIMSK1 |= _BV(OCIE1A);
+                SREG = oldSREG;
+                return true;
+            }
+        }
+        return false;
+#    else
+        static const uint16_t prescalers[]      = {1, 2, 4, 8, 16, 64, 256, 1024};
+        static const uint32_t prescaler_bits[] = {TC_CTRLA_PRESCALER_DIV1,
+                                                  TC_CTRLA_PRESCALER_DIV2,
+                                                  TC_CTRLA_PRESCALER_DIV4,
+                                                  TC_CTRLA_PRESCALER_DIV8,
+                                                  TC_CTRLA_PRESCALER_DIV16,
+                                                  TC_CTRLA_PRESCALER_DIV64,
+                                                  TC_CTRLA_PRESCALER_DIV256,
+                                                  TC_CTRLA_PRESCALER_DIV1024};
+        for (uint8_t i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); ++i)
+        {
+            // TC3 is clocked from GCLK0 which runs at F_CPU.
+            const uint32_t ticks = F_CPU / (static_cast<uint32_t>(prescalers[i]) * rate_hz);
+            if (ticks > 0 && ticks <= 0x10000UL)
+            {
+                GCLK->CLKCTRL.reg = static_cast<uint16_t>(GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3);
+                while (GCLK->STATUS.bit.SYNCBUSY)
+                {
+                }
+                end();
+                TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | prescaler_bits[i];
+                sync();
+                TC3->COUNT16.CC[0].reg = static_cast<uint16_t>(ticks - 1);
+                sync();
+                TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+                NVIC_EnableIRQ(TC3_IRQn);
+                TC3->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+                sync();
+                return true;
+            }
+        }
+        return false;
+#    endif
+    }
+
+    /**
+     * Stops the timer interrupt.
+     */
+    static void end()
+    {
+#    if defined(__AVR__)
+        TIMSK1 &= ~_BV(OCIE1A);
+        TCCR1B = 0;
+#    else
+        TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+        sync();
+        TC3->COUNT16.INTENCLR.reg = TC_INTENCLR_MC0;
+#    endif
+    }
+
+#    if !defined(__AVR__)
+    /*
+     * Used by SWITCH_MATRIX_SCAN_TIMER_ISR. You can ignore it.
+     */
+    static void acknowledge()
+    {
+        TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    }
+
+private:
+    static void sync()
+    {
+        while (TC3->COUNT16.STATUS.bit.SYNCBUSY)
+        {
+        }
+    }
+#    endif
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+/**
+ * Defines the timer interrupt handler. Follow it with the body to run at the rate given to
+ * SwitchMatrixScanTimer::begin.
+ */
+#    if defined(__AVR__)
+#        define SWITCH_MATRIX_SCAN_TIMER_ISR()            \
+            static void switch_matrix_scan_timer_body(); \
+            ISR(TIMER1_COMPA_vect)                       \
+            {                                            \
+                switch_matrix_scan_timer_body();         \
+            }                                            \
+            static void switch_matrix_scan_timer_body()
+#    else
+#        define SWITCH_MATRIX_SCAN_TIMER_ISR()                              \
+            static void switch_matrix_scan_timer_body();                   \
+            void        TC3_Handler()                                      \
+            {                                                              \
+                gh::thirtytwobits::SwitchMatrixScanTimer::acknowledge(); \
+                switch_matrix_scan_timer_body();                           \
+            }                                                              \
+            static void switch_matrix_scan_timer_body()
+#    endif
+
+#endif  // defined(__AVR__) || (defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__))
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_SCAN_TIMER_H
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 namespace gh
 {
@@ -43,55 +44,2575 @@ using ScanCodeType = uint16_t;
 namespace
 {
 /*
- * This is used by the SwitchMatrixScanner class internally. You can ignore it.
+ * C++11 stand-in for std::index_sequence.
  */
-enum SwitchState : uint8_t
+template <size_t... I>
+struct Indices
+{};
+
+template <size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{};
+
+template <size_t... I>
+struct MakeIndices<0, I...>
+{
+    using type = Indices<I...>;
+};
+
+/*
+ * A row mask for matrices with more than 64 columns, held in WORDS 32-bit words with column 0 in bit 0 of the
+ * first word. It supports the bitwise operators and the comparisons the row masks are used with so the
+ * scanner and the policies don't need to know which kind of mask they have.
+ */
+template <size_t WORDS>
+class WideRowMask
+{
+public:
+    using Word = uint32_t;
+
+    static constexpr const size_t word_bits = 32;
+
+    constexpr WideRowMask()
+        : m_words{}
+    {}
+
+    // Not explicit so masks can be compared with, and assigned from, 0 like the integer masks.
+    constexpr WideRowMask(const unsigned long long value)
+        : WideRowMask(value, typename MakeIndices<WORDS>::type())
+    {}
+
+    /*
+     * The lowest count bits set.
+     */
+    static constexpr WideRowMask lowBits(const size_t count)
+    {
+        return WideRowMask(LowBits(), count, typename MakeIndices<WORDS>::type());
+    }
+
+    Word word(const size_t index) const
+    {
+        return m_words[index];
+    }
+
+    Word& word(const size_t index)
+    {
+        return m_words[index];
+    }
+
+    WideRowMask& operator&=(const WideRowMask& rhs)
+    {
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            m_words[i] &= rhs.m_words[i];
+        }
+        return *this;
+    }
+
+    WideRowMask& operator|=(const WideRowMask& rhs)
+    {
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            m_words[i] |= rhs.m_words[i];
+        }
+        return *this;
+    }
+
+    WideRowMask& operator^=(const WideRowMask& rhs)
+    {
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            m_words[i] ^= rhs.m_words[i];
+        }
+        return *this;
+    }
+
+    WideRowMask operator~() const
+    {
+        WideRowMask result;
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            result.m_words[i] = ~m_words[i];
+        }
+        return result;
+    }
+
+    friend WideRowMask operator&(WideRowMask lhs, const WideRowMask& rhs)
+    {
+        return lhs &= rhs;
+    }
+
+    friend WideRowMask operator|(WideRowMask lhs, const WideRowMask& rhs)
+    {
+        return lhs |= rhs;
+    }
+
+    friend WideRowMask operator^(WideRowMask lhs, const WideRowMask& rhs)
+    {
+        return lhs ^= rhs;
+    }
+
+    friend bool operator==(const WideRowMask& lhs, const WideRowMask& rhs)
+    {
+        for (size_t i = 0; i < WORDS; ++i)
+        {
+            if (lhs.m_words[i] != rhs.m_words[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=(const WideRowMask& lhs, const WideRowMask& rhs)
+    {
+        return !(lhs == rhs);
+    }
+
+private:
+    struct LowBits
+    {};
+
+    static constexpr Word low_bits_word(const size_t index, const size_t count)
+    {
+        return (count >= (index + 1) * word_bits) ? ~static_cast<Word>(0)
+               : (count <= index * word_bits)     ? 0
+                                                  : static_cast<Word>((static_cast<Word>(1) << (count - index * word_bits)) - 1);
+    }
+
+    template <size_t... I>
+    constexpr WideRowMask(const unsigned long long value, Indices<I...>)
+        : m_words{static_cast<Word>((I < 2) ? (value >> ((I % 2) * word_bits)) : 0)...}
+    {}
+
+    template <size_t... I>
+    constexpr WideRowMask(LowBits, const size_t count, Indices<I...>)
+        : m_words{low_bits_word(I, count)...}
+    {}
+
+    Word m_words[WORDS];
+};
+
+/*
+ * Selects the smallest unsigned integer that can hold one bit per column, or a WideRowMask past 64 columns.
+ * Used for the row samples returned by the pin access policies. You can ignore it.
+ */
+template <size_t COL_COUNT,
+          bool FITS_8  = (COL_COUNT <= 8),
+          bool FITS_16 = (COL_COUNT <= 16),
+          bool FITS_32 = (COL_COUNT <= 32),
+          bool FITS_64 = (COL_COUNT <= 64)>
+struct RowMaskTraits
+{
+    using type = WideRowMask<(COL_COUNT + 31) / 32>;
+};
+
+template <size_t COL_COUNT, bool FITS_16, bool FITS_32, bool FITS_64>
+struct RowMaskTraits<COL_COUNT, true, FITS_16, FITS_32, FITS_64>
+{
+    using type = uint8_t;
+};
+
+template <size_t COL_COUNT, bool FITS_32, bool FITS_64>
+struct RowMaskTraits<COL_COUNT, false, true, FITS_32, FITS_64>
+{
+    using type = uint16_t;
+};
+
+template <size_t COL_COUNT, bool FITS_64>
+struct RowMaskTraits<COL_COUNT, false, false, true, FITS_64>
+{
+    using type = uint32_t;
+};
+
+template <size_t COL_COUNT>
+struct RowMaskTraits<COL_COUNT, false, false, false, true>
+{
+    using type = uint64_t;
+};
+
+/*
+ * The row mask operations that need arithmetic have an integer and a WideRowMask version, picked by the type
+ * of the tag pointer.
+ */
+template <typename RowMask>
+constexpr RowMask column_bit_of(const size_t column, const RowMask*)
+{
+    return static_cast<RowMask>(static_cast<RowMask>(1) << column);
+}
+
+template <size_t WORDS>
+constexpr WideRowMask<WORDS> column_bit_of(const size_t column, const WideRowMask<WORDS>*)
+{
+    return WideRowMask<WORDS>::lowBits(column + 1) & ~WideRowMask<WORDS>::lowBits(column);
+}
+
+template <typename RowMask>
+constexpr RowMask column_mask_of(const size_t col_count, const RowMask*)
+{
+    return (col_count >= sizeof(RowMask) * 8)
+               ? static_cast<RowMask>(~static_cast<RowMask>(0))
+               : static_cast<RowMask>(column_bit_of(col_count % (sizeof(RowMask) * 8), static_cast<const RowMask*>(nullptr)) - 1);
+}
+
+template <size_t WORDS>
+constexpr WideRowMask<WORDS> column_mask_of(const size_t col_count, const WideRowMask<WORDS>*)
+{
+    return WideRowMask<WORDS>::lowBits(col_count);
+}
+
+template <typename RowMask>
+constexpr RowMask column_bit(const size_t column)
+{
+    return column_bit_of(column, static_cast<const RowMask*>(nullptr));
+}
+
+template <typename RowMask>
+constexpr RowMask column_mask(const size_t col_count)
+{
+    return column_mask_of(col_count, static_cast<const RowMask*>(nullptr));
+}
+
+/*
+ * Index of the lowest set bit. The argument must not be 0.
+ */
+inline uint8_t lowest_column(const uint8_t mask)
+{
+    return static_cast<uint8_t>(__builtin_ctz(mask));
+}
+
+inline uint8_t lowest_column(const uint16_t mask)
+{
+    return static_cast<uint8_t>(__builtin_ctz(mask));
+}
+
+inline uint8_t lowest_column(const uint32_t mask)
+{
+    return static_cast<uint8_t>(__builtin_ctzl(mask));
+}
+
+inline uint8_t lowest_column(const uint64_t mask)
+{
+    return static_cast<uint8_t>(__builtin_ctzll(mask));
+}
+
+template <size_t WORDS>
+inline uint8_t lowest_column(const WideRowMask<WORDS>& mask)
+{
+    size_t i = 0;
+    while (mask.word(i) == 0)
+    {
+        ++i;
+    }
+    return static_cast<uint8_t>(i * WideRowMask<WORDS>::word_bits + __builtin_ctzl(mask.word(i)));
+}
+
+/*
+ * The mask with its lowest set bit cleared.
+ */
+template <typename RowMask>
+inline RowMask clear_lowest_column(const RowMask mask)
+{
+    return static_cast<RowMask>(mask & (mask - 1));
+}
+
+template <size_t WORDS>
+inline WideRowMask<WORDS> clear_lowest_column(WideRowMask<WORDS> mask)
+{
+    for (size_t i = 0; i < WORDS; ++i)
+    {
+        if (mask.word(i) != 0)
+        {
+            mask.word(i) &= mask.word(i) - 1;
+            break;
+        }
+    }
+    return mask;
+}
+
+/*
+ * Byte index of a mask, where byte 0 holds columns 0 to 7. Used to send masks over a link.
+ */
+template <typename RowMask>
+inline uint8_t row_mask_byte(const RowMask mask, const size_t index)
+{
+    return static_cast<uint8_t>(mask >> (8 * index));
+}
+
+template <size_t WORDS>
+inline uint8_t row_mask_byte(const WideRowMask<WORDS>& mask, const size_t index)
+{
+    return static_cast<uint8_t>(mask.word(index / 4) >> (8 * (index % 4)));
+}
+
+template <typename RowMask>
+inline void set_row_mask_byte(RowMask& mask, const size_t index, const uint8_t value)
+{
+    mask = static_cast<RowMask>(mask | (static_cast<RowMask>(value) << (8 * index)));
+}
+
+template <size_t WORDS>
+inline void set_row_mask_byte(WideRowMask<WORDS>& mask, const size_t index, const uint8_t value)
+{
+    mask.word(index / 4) |= static_cast<uint32_t>(value) << (8 * (index % 4));
+}
+
+/*
+ * Number of bits needed to hold v.
+ */
+constexpr uint8_t bit_width(const uint32_t v)
+{
+    return (v == 0) ? 0 : static_cast<uint8_t>(1 + bit_width(v >> 1));
+}
+
+/*
+ * Vertical counters: PLANES words hold one counter per column where planes[i] is bit i of every counter.
+ * This decrements every non-zero counter and returns the columns that were non-zero.
+ */
+template <size_t PLANES, typename RowMask>
+RowMask vertical_count_down(RowMask (&planes)[PLANES])
+{
+    RowMask active = 0;
+    for (size_t i = 0; i < PLANES; ++i)
+    {
+        active |= planes[i];
+    }
+    RowMask borrow = active;
+    for (size_t i = 0; i < PLANES; ++i)
+    {
+        const RowMask bit = planes[i];
+        planes[i]         = static_cast<RowMask>(bit ^ borrow);
+        borrow            = static_cast<RowMask>(borrow & ~bit);
+    }
+    return active;
+}
+
+/*
+ * Sets the vertical counters of the given columns to value.
+ */
+template <size_t PLANES, typename RowMask>
+void vertical_count_load(RowMask (&planes)[PLANES], const RowMask columns, const uint32_t value)
+{
+    for (size_t i = 0; i < PLANES; ++i)
+    {
+        const RowMask value_bit = ((value >> i) & 1) ? columns : 0;
+        planes[i]               = static_cast<RowMask>((planes[i] & ~columns) | value_bit);
+    }
+}
+
+template <size_t PLANES, typename RowMask>
+RowMask vertical_count_active(const RowMask (&planes)[PLANES])
+{
+    RowMask active = 0;
+    for (size_t i = 0; i < PLANES; ++i)
+    {
+        active |= planes[i];
+    }
+    return active;
+}
+
+/*
+ * Shifts sample into the history planes (history[0] is the newest) for every column not in hold.
+ */
+template <size_t DEPTH, typename RowMask>
+void shift_history(RowMask (&history)[DEPTH], const RowMask sample, const RowMask hold)
+{
+    for (size_t k = DEPTH - 1; k > 0; --k)
+    {
+        history[k] = static_cast<RowMask>((history[k] & hold) | (history[k - 1] & ~hold));
+    }
+    history[0] = static_cast<RowMask>((history[0] & hold) | (sample & ~hold));
+}
+
+};  // namespace
+
+#if defined(__AVR__) && defined(digitalPinToPCICR)
+/*
+ * Handlers for the pin change interrupts used to wake from idle mode on column pins that aren't external
+ * interrupt pins (you can ignore this). Pin change interrupts are only used once SwitchMatrixPinChangeWake.h,
+ * which defines the vectors, has been included somewhere in the sketch.
+ */
+struct PinChangeWake final
+{
+    using Handler = void (*)();
+
+    static constexpr const uint8_t group_count = 4;
+
+    PinChangeWake() = delete;
+
+    static bool& installed()
+    {
+        static bool vectors_installed = false;
+        return vectors_installed;
+    }
+
+    // The handler for each PCMSK bit of a group, or nullptr.
+    static Handler (&handlers(const uint8_t group))[8]
+    {
+        static Handler table[group_count][8] = {};
+        return table[group];
+    }
+
+    // A pin change interrupt says which group changed but not which pin so every armed handler in it runs.
+    static void dispatch(const uint8_t group)
+    {
+        Handler(&armed)[8] = handlers(group);
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            if (armed[bit] != nullptr)
+            {
+                armed[bit]();
+            }
+        }
+    }
+};
+#endif
+
+namespace
+{
+/*
+ * Arms (or disarms when isr is null) a pin change interrupt for pin. Returns false if the pin doesn't have one
+ * or SwitchMatrixPinChangeWake.h wasn't included.
+ */
+inline bool set_pin_change_interrupt(const uint8_t pin, void (*isr)())
+{
+#if defined(__AVR__) && defined(digitalPinToPCICR)
+    volatile uint8_t* const pcicr = digitalPinToPCICR(pin);
+    if (pcicr == nullptr || !PinChangeWake::installed())
+    {
+        return false;
+    }
+    volatile uint8_t* const pcmsk   = digitalPinToPCMSK(pin);
+    const uint8_t           group   = digitalPinToPCICRbit(pin);
+    const uint8_t           bit     = digitalPinToPCMSKbit(pin);
+    const uint8_t           oldSREG = SREG;
+    cli();
+    if (isr != nullptr)
+    {
+        PinChangeWake::handlers(group)[bit] = isr;
+        *pcmsk |= _BV(bit);
+        PCIFR = _BV(group);
+        *pcicr |= _BV(group);
+    }
+    else
+    {
+        *pcmsk &= ~_BV(bit);
+        PinChangeWake::handlers(group)[bit] = nullptr;
+        if (*pcmsk == 0)
+        {
+            *pcicr &= ~_BV(group);
+        }
+    }
+    SREG = oldSREG;
+    return true;
+#else
+    (void) pin;
+    (void) isr;
+    return false;
+#endif
+}
+
+/*
+ * Attaches (or detaches when isr is null) a falling-edge interrupt to every column pin that has one, or a pin
+ * change interrupt on AVR pins that don't. On SAMD only one pin can be connected to each EXTINT line so only
+ * the first column on a line is attached. Returns false if any column can't interrupt.
+ */
+template <size_t COL_COUNT>
+bool set_column_interrupts(const uint8_t (&column_pins)[COL_COUNT], void (*isr)())
+{
+#if defined(digitalPinToInterrupt)
+    bool all_attached = true;
+#    if defined(ARDUINO_ARCH_SAMD)
+    uint32_t lines = 0;
+#    endif
+    for (size_t c = 0; c < COL_COUNT; ++c)
+    {
+        const int irq = digitalPinToInterrupt(column_pins[c]);
+#    if defined(ARDUINO_ARCH_SAMD)
+        // digitalPinToInterrupt is the pin itself on newer cores so look the line up.
+        const int line = static_cast<int>(g_APinDescription[column_pins[c]].ulExtInt);
+        if (irq == NOT_AN_INTERRUPT || line == NOT_AN_INTERRUPT || (lines & (1UL << (line & 31))) != 0)
+        {
+            all_attached = false;
+            continue;
+        }
+        lines |= 1UL << (line & 31);
+#    else
+        if (irq == NOT_AN_INTERRUPT)
+        {
+            all_attached = set_pin_change_interrupt(column_pins[c], isr) && all_attached;
+            continue;
+        }
+#    endif
+        if (isr != nullptr)
+        {
+            attachInterrupt(irq, isr, FALLING);
+        }
+        else
+        {
+            detachInterrupt(irq);
+        }
+    }
+    return all_attached;
+#else
+    (void) column_pins;
+    (void) isr;
+    return false;
+#endif
+}
+
+/*
+ * Moves the selection from row from to row to. Pin policies may provide advanceRow to do this in one step,
+ * which matters for row drivers that rewrite every row at once such as shift registers. Otherwise this is
+ * releaseRow then selectRow.
+ */
+template <typename PINS>
+auto advance_row(PINS& pins, const size_t from, const size_t to, int) -> decltype(pins.advanceRow(from, to))
+{
+    return pins.advanceRow(from, to);
+}
+
+template <typename PINS>
+void advance_row(PINS& pins, const size_t from, const size_t to, long)
+{
+    pins.releaseRow(from);
+    pins.selectRow(to);
+}
+
+template <typename PINS>
+void advance_row(PINS& pins, const size_t from, const size_t to)
+{
+    advance_row(pins, from, to, 0);
+}
+
+/*
+ * Scancode tables live in flash on AVR where they have to be read with pgm_read_word.
+ */
+inline ScanCodeType read_scancode_table(const ScanCodeType* const table, const size_t index)
+{
+#if defined(pgm_read_word)
+    return static_cast<ScanCodeType>(pgm_read_word(table + index));
+#else
+    return table[index];
+#endif
+}
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | PIN ACCESS POLICIES
+// +--------------------------------------------------------------------------+
+/**
+ * Pin access policies tell the SwitchMatrixScanner how to drive its rows and sample its columns. A policy is a
+ * type with a nested `Driver` template that provides:
+ *
+ *      template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+ *      class Driver
+ *      {
+ *      public:
+ *          Driver(const uint8_t (&row_pins)[ROW_COUNT], const uint8_t (&column_pins)[COL_COUNT]);
+ *          void    setup(uint8_t column_input_type);  // called once from SwitchMatrixScanner::setup
+ *          void    selectRow(size_t row);             // drive the row LOW
+ *          void    releaseRow(size_t row);            // return the row to high-impedance
+ *          void    advanceRow(size_t from, size_t to); // optional: releaseRow(from) then selectRow(to) at once
+ *          void    selectAllRows();                   // drive every row LOW (idle mode)
+ *          void    releaseAllRows();
+ *          RowMask readColumns() const;               // bit c is set if column c reads LOW
+ *          bool    armWake(void (*isr)());            // call isr when any column falls. false if some can't.
+ *          void    disarmWake();
+ *      };
+ *
+ * ArduinoPins is the default and uses only pinMode, digitalWrite, and digitalRead.
+ */
+
+/**
+ * Builds a pin access policy from separate row and column halves so, for example, rows can be driven through
+ * shift registers while the columns are read from an I/O expander (see SwitchMatrixShiftRegisterRows.h and
+ * SwitchMatrixMcp23017Columns.h). The halves provide:
+ *
+ *      template <size_t ROW_COUNT>
+ *      class Driver  // ROWS
+ *      {
+ *      public:
+ *          Driver(const uint8_t (&row_pins)[ROW_COUNT]);
+ *          void setup();
+ *          void selectRow(size_t row);
+ *          void releaseRow(size_t row);
+ *          void advanceRow(size_t from, size_t to);  // optional
+ *          void selectAllRows();
+ *          void releaseAllRows();
+ *      };
+ *
+ *      template <size_t COL_COUNT, typename RowMask>
+ *      class Reader  // COLUMNS
+ *      {
+ *      public:
+ *          Reader(const uint8_t (&column_pins)[COL_COUNT]);
+ *          void    setup(uint8_t column_input_type);
+ *          RowMask readColumns() const;
+ *          bool    armWake(void (*isr)());
+ *          void    disarmWake();
+ *      };
+ *
+ * The row and column "pins" given to the SwitchMatrixScanner are passed through to the halves which decide
+ * what they mean.
+ */
+template <typename ROWS, typename COLUMNS>
+struct SplitPins
+{
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&row_pins)[ROW_COUNT], const uint8_t (&column_pins)[COL_COUNT])
+            : m_rows(row_pins)
+            , m_columns(column_pins)
+        {}
+
+        void setup(const uint8_t column_input_type)
+        {
+            m_rows.setup();
+            m_columns.setup(column_input_type);
+        }
+
+        void selectRow(const size_t row)
+        {
+            m_rows.selectRow(row);
+        }
+
+        void releaseRow(const size_t row)
+        {
+            m_rows.releaseRow(row);
+        }
+
+        void advanceRow(const size_t from, const size_t to)
+        {
+            advance_row(m_rows, from, to);
+        }
+
+        void selectAllRows()
+        {
+            m_rows.selectAllRows();
+        }
+
+        void releaseAllRows()
+        {
+            m_rows.releaseAllRows();
+        }
+
+        bool armWake(void (*isr)())
+        {
+            return m_columns.armWake(isr);
+        }
+
+        void disarmWake()
+        {
+            m_columns.disarmWake();
+        }
+
+        RowMask readColumns() const
+        {
+            return m_columns.readColumns();
+        }
+
+    private:
+        typename ROWS::template Driver<ROW_COUNT>             m_rows;
+        typename COLUMNS::template Reader<COL_COUNT, RowMask> m_columns;
+    };
+};
+
+/**
+ * Rows driven with pinMode and digitalWrite. A selected row is driven LOW and the others are left
+ * high-impedance.
+ */
+struct ArduinoRows
+{
+    template <size_t ROW_COUNT>
+    class Driver
+    {
+    public:
+        explicit Driver(const uint8_t (&row_pins)[ROW_COUNT])
+            : m_row_pins()
+        {
+            memcpy(m_row_pins, row_pins, sizeof(row_pins));
+        }
+
+        void setup()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                pinMode(m_row_pins[r], INPUT);
+            }
+        }
+
+        void selectRow(const size_t row)
+        {
+            const uint8_t rowpin = m_row_pins[row];
+            pinMode(rowpin, OUTPUT);
+            digitalWrite(rowpin, LOW);
+        }
+
+        void releaseRow(const size_t row)
+        {
+            // High-impedance
+            pinMode(m_row_pins[row], INPUT);
+        }
+
+        void selectAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                selectRow(r);
+            }
+        }
+
+        void releaseAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                releaseRow(r);
+            }
+        }
+
+    private:
+        uint8_t m_row_pins[ROW_COUNT];
+    };
+};
+
+/**
+ * Columns read with digitalRead.
+ */
+struct ArduinoColumns
+{
+    template <size_t COL_COUNT, typename RowMask>
+    class Reader
+    {
+    public:
+        explicit Reader(const uint8_t (&column_pins)[COL_COUNT])
+            : m_col_pins()
+        {
+            memcpy(m_col_pins, column_pins, sizeof(column_pins));
+        }
+
+        void setup(const uint8_t column_input_type)
+        {
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                pinMode(m_col_pins[c], column_input_type);
+            }
+        }
+
+        bool armWake(void (*isr)())
+        {
+            return set_column_interrupts(m_col_pins, isr);
+        }
+
+        void disarmWake()
+        {
+            set_column_interrupts(m_col_pins, nullptr);
+        }
+
+        RowMask readColumns() const
+        {
+            RowMask sample = 0;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                if (digitalRead(m_col_pins[c]) == LOW)
+                {
+                    sample |= column_bit<RowMask>(c);
+                }
+            }
+            return sample;
+        }
+
+    private:
+        uint8_t m_col_pins[COL_COUNT];
+    };
+};
+
+/**
+ * The default pin access policy.
+ */
+using ArduinoPins = SplitPins<ArduinoRows, ArduinoColumns>;
+
+/**
+ * How the row drivers that configure their pins once in setup drive unselected rows.
+ */
+enum class RowDrive : uint8_t
+{
+    // Rows are only ever pulled LOW and float otherwise, so any matrix works.
+    OPEN_DRAIN = 0,
+    // Unselected rows are driven HIGH. Only for matrices with a diode on every switch since without one two
+    // switches closed in the same column would short a HIGH row to the selected LOW one. The rows then sit at
+    // the level of the column pullups between frames so held switches draw no current and no row floats.
+    PUSH_PULL = 1
+};
+
+namespace
+{
+#if defined(OUTPUT_OPEN_DRAIN)
+constexpr bool    HasOpenDrainOutput  = true;
+constexpr uint8_t OpenDrainOutputMode = OUTPUT_OPEN_DRAIN;
+#else
+constexpr bool    HasOpenDrainOutput  = false;
+constexpr uint8_t OpenDrainOutputMode = OUTPUT;
+#endif
+};  // namespace
+
+/**
+ * Rows set up as outputs once so selecting or releasing a row is a single digitalWrite instead of the two
+ * pinMode calls ArduinoRows makes, which on many cores are far slower than a write and reconfigure the pull
+ * resistors every time. RowDrive::OPEN_DRAIN needs a core with OUTPUT_OPEN_DRAIN (ESP32, STM32 and others).
+ * On AVR and SAMD use DirectPortPins instead, which gets the same effect from the direction register.
+ *
+ * Example:
+ *
+ *      using Rows = gh::thirtytwobits::DrivenRows<gh::thirtytwobits::RowDrive::PUSH_PULL>;
+ *      using Pins = gh::thirtytwobits::SplitPins<Rows, gh::thirtytwobits::ArduinoColumns>;
+ */
+template <RowDrive DRIVE = RowDrive::OPEN_DRAIN>
+struct DrivenRows
+{
+    template <size_t ROW_COUNT>
+    class Driver
+    {
+    public:
+        static_assert(DRIVE == RowDrive::PUSH_PULL || HasOpenDrainOutput,
+                      "This core has no OUTPUT_OPEN_DRAIN pin mode. Use DirectPortPins or ArduinoRows.");
+
+        explicit Driver(const uint8_t (&row_pins)[ROW_COUNT])
+            : m_row_pins()
+        {
+            memcpy(m_row_pins, row_pins, sizeof(row_pins));
+        }
+
+        void setup()
+        {
+            const uint8_t mode = (DRIVE == RowDrive::OPEN_DRAIN) ? OpenDrainOutputMode : OUTPUT;
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                // Latch HIGH first so the row doesn't pull its columns LOW when it becomes an output.
+                digitalWrite(m_row_pins[r], HIGH);
+                pinMode(m_row_pins[r], mode);
+            }
+        }
+
+        void selectRow(const size_t row)
+        {
+            digitalWrite(m_row_pins[row], LOW);
+        }
+
+        void releaseRow(const size_t row)
+        {
+            digitalWrite(m_row_pins[row], HIGH);
+        }
+
+        void selectAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                selectRow(r);
+            }
+        }
+
+        void releaseAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                releaseRow(r);
+            }
+        }
+
+    private:
+        uint8_t m_row_pins[ROW_COUNT];
+    };
+};
+
+#if defined(__AVR__) || defined(ARDUINO_ARCH_SAMD)
+/**
+ * Talks to the GPIO port registers directly. The pin-to-port lookups are done once in setup() and every column
+ * that shares a port is sampled with a single read of that port's input register.
+ *
+ * The row registers are configured once in setup() too so selecting or releasing a row is one register write.
+ * With RowDrive::OPEN_DRAIN (DirectPortPins) the output latch is left LOW and only the direction register
+ * changes. With RowDrive::PUSH_PULL (for matrices with diodes) the rows stay outputs and only the output
+ * register changes.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::DirectPortPins> scanner(
+ *          rowPins,
+ *          colPins);
+ */
+template <RowDrive DRIVE>
+struct BasicDirectPortPins
+{
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+#    if defined(__AVR__)
+        using PortRegister = volatile uint8_t;
+        using PortMask     = uint8_t;
+#    else
+        using PortRegister = volatile uint32_t;
+        using PortMask     = uint32_t;
+#    endif
+        using PortInput = const PortRegister;
+
+    public:
+        Driver(const uint8_t (&row_pins)[ROW_COUNT], const uint8_t (&column_pins)[COL_COUNT])
+            : m_row_pins()
+            , m_col_pins()
+            , m_row_mask()
+#    if defined(__AVR__)
+            , m_row_mode()
+            , m_row_out()
+#    else
+            , m_row_group()
+#    endif
+            , m_port_in()
+            , m_port_count(0)
+            , m_col_port()
+            , m_col_mask()
+        {
+            memcpy(m_row_pins, row_pins, sizeof(row_pins));
+            memcpy(m_col_pins, column_pins, sizeof(column_pins));
+        }
+
+        void setup(const uint8_t column_input_type)
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                const uint8_t rowpin = m_row_pins[r];
+                pinMode(rowpin, INPUT);
+                m_row_mask[r] = digitalPinToBitMask(rowpin);
+#    if defined(__AVR__)
+                m_row_mode[r] = portModeRegister(digitalPinToPort(rowpin));
+                m_row_out[r]  = portOutputRegister(digitalPinToPort(rowpin));
+#    else
+                m_row_group[r] = digitalPinToPort(rowpin);
+#    endif
+                if (DRIVE == RowDrive::PUSH_PULL)
+                {
+                    digitalWrite(rowpin, HIGH);
+                    pinMode(rowpin, OUTPUT);
+                }
+#    if !defined(__AVR__)
+                else
+                {
+                    // pinMode clears the latch on AVR but not here. It stays LOW from here on so a row is
+                    // selected by making it an output.
+                    m_row_group[r]->OUTCLR.reg = m_row_mask[r];
+                }
+#    endif
+            }
+            m_port_count = 0;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                const uint8_t colpin = m_col_pins[c];
+                pinMode(colpin, column_input_type);
+                PortInput* const in = portInputRegister(digitalPinToPort(colpin));
+                uint8_t             p  = 0;
+                while (p < m_port_count && m_port_in[p] != in)
+                {
+                    ++p;
+                }
+                if (p == m_port_count)
+                {
+                    m_port_in[m_port_count++] = in;
+                }
+                m_col_port[c] = p;
+                m_col_mask[c] = digitalPinToBitMask(colpin);
+            }
+        }
+
+        void selectRow(const size_t row)
+        {
+            const PortMask mask = m_row_mask[row];
+#    if defined(__AVR__)
+            // Same protection pinMode uses since ISRs may touch other pins on this port.
+            const uint8_t oldSREG = SREG;
+            cli();
+            if (DRIVE == RowDrive::PUSH_PULL)
+            {
+                *m_row_out[row] &= ~mask;
+            }
+            else
+            {
+                *m_row_mode[row] |= mask;
+            }
+            SREG = oldSREG;
+#    else
+            if (DRIVE == RowDrive::PUSH_PULL)
+            {
+                m_row_group[row]->OUTCLR.reg = mask;
+            }
+            else
+            {
+                m_row_group[row]->DIRSET.reg = mask;
+            }
+#    endif
+        }
+
+        void releaseRow(const size_t row)
+        {
+            const PortMask mask = m_row_mask[row];
+#    if defined(__AVR__)
+            // For OPEN_DRAIN the output latch is already LOW so this leaves the pin high-impedance without a
+            // pullup.
+            const uint8_t oldSREG = SREG;
+            cli();
+            if (DRIVE == RowDrive::PUSH_PULL)
+            {
+                *m_row_out[row] |= mask;
+            }
+            else
+            {
+                *m_row_mode[row] &= ~mask;
+            }
+            SREG = oldSREG;
+#    else
+            if (DRIVE == RowDrive::PUSH_PULL)
+            {
+                m_row_group[row]->OUTSET.reg = mask;
+            }
+            else
+            {
+                m_row_group[row]->DIRCLR.reg = mask;
+            }
+#    endif
+        }
+
+        void selectAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                selectRow(r);
+            }
+        }
+
+        void releaseAllRows()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                releaseRow(r);
+            }
+        }
+
+        bool armWake(void (*isr)())
+        {
+            return set_column_interrupts(m_col_pins, isr);
+        }
+
+        void disarmWake()
+        {
+            set_column_interrupts(m_col_pins, nullptr);
+        }
+
+        RowMask readColumns() const
+        {
+            PortMask port_values[COL_COUNT];
+            for (uint8_t p = 0; p < m_port_count; ++p)
+            {
+                port_values[p] = *m_port_in[p];
+            }
+            RowMask sample = 0;
+            for (size_t c = 0; c < COL_COUNT; ++c)
+            {
+                if ((port_values[m_col_port[c]] & m_col_mask[c]) == 0)
+                {
+                    sample |= column_bit<RowMask>(c);
+                }
+            }
+            return sample;
+        }
+
+    private:
+        uint8_t m_row_pins[ROW_COUNT];
+        uint8_t m_col_pins[COL_COUNT];
+
+        PortMask m_row_mask[ROW_COUNT];
+#    if defined(__AVR__)
+        PortRegister* m_row_mode[ROW_COUNT];
+        PortRegister* m_row_out[ROW_COUNT];
+#    else
+        PortGroup* m_row_group[ROW_COUNT];
+#    endif
+
+        PortInput* m_port_in[COL_COUNT];
+        uint8_t    m_port_count;
+        uint8_t    m_col_port[COL_COUNT];
+        PortMask   m_col_mask[COL_COUNT];
+    };
+};
+
+/**
+ * Rows float when not selected so any matrix works.
+ */
+using DirectPortPins = BasicDirectPortPins<RowDrive::OPEN_DRAIN>;
+#endif
+
+// +--------------------------------------------------------------------------+
+// | DEBOUNCE POLICIES
+// +--------------------------------------------------------------------------+
+/**
+ * Debounce policies decide when the samples of a switch are stable enough to change its state. A policy is a
+ * type with a static `now()` that returns the timestamp handed to its per-row state and a nested `Row`
+ * template that holds that state:
+ *
+ *      static constexpr const bool enabled = true;  // false skips the policy entirely (see NoDebounce)
+ *      static uint32_t now();
+ *
+ *      template <size_t COL_COUNT, typename RowMask>
+ *      class Row
+ *      {
+ *      public:
+ *          Row();
+ *          // Adds a sample and reports which switches now read as debounced CLOSED and as debounced OPEN.
+ *          void update(RowMask sample, uint32_t now, RowMask& closed_samples, RowMask& open_samples);
+ *          // Called with the switches whose state was just committed.
+ *          void restart(RowMask switches, uint32_t now);
+ *          // True if the row could still change even if its next sample equals the given closed state.
+ *          bool inFlight(RowMask closed) const;
+ *      };
+ *
+ * Every switch in a row is handled by one call so policies are expected to work on whole RowMasks.
+ */
+
+/**
+ * The tuning parameters for CountedDebounce. To change them derive from this and hide the values you want to
+ * change:
+ *
+ *      struct SlowSwitches : gh::thirtytwobits::DefaultDebounceTraits
+ *      {
+ *          static constexpr const uint8_t DebounceSettleCount = 3;
+ *          static constexpr const uint8_t DebounceSampleCount = 4;
+ *      };
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::ArduinoPins,
+ *                                             gh::thirtytwobits::CountedDebounce<SlowSwitches>> scanner(...);
+ */
+struct DefaultDebounceTraits
+{
+    // Scans ignored after every state change.
+    static constexpr const uint8_t DebounceSettleCount = 1;
+    // Consecutive samples that must agree before a state change.
+    static constexpr const uint8_t DebounceSampleCount = 2;
+    // Bits available for the settle count.
+    static constexpr const uint8_t DebounceSettleBits = 3;
+    // Bits available for the sample history.
+    static constexpr const uint8_t DebounceSampleBits = 5;
+};
+
+/**
+ * The default policy. Counts scan calls: each switch must read the same for DebounceSampleCount consecutive
+ * samples before its state changes and then ignores DebounceSettleCount scans after every change. Samples are
+ * stored as bit planes with one word per sample of history so a row is updated with a few word operations.
+ * The parameters come from TRAITS (see DefaultDebounceTraits).
+ */
+template <typename TRAITS = DefaultDebounceTraits>
+struct CountedDebounce
+{
+    static constexpr const bool enabled = true;
+
+    static constexpr const uint8_t DebounceSettleCount = TRAITS::DebounceSettleCount;
+    static constexpr const uint8_t DebounceSampleCount = TRAITS::DebounceSampleCount;
+    static constexpr const uint8_t DebounceSettleBits  = TRAITS::DebounceSettleBits;
+    static constexpr const uint8_t DebounceSampleBits  = TRAITS::DebounceSampleBits;
+
+    // +----------------------------------------------------------------------+
+    // | SOFTWARE DEBOUNCING PARAMETERS :: VALIDATION
+    // +----------------------------------------------------------------------+
+    static_assert(DebounceSettleCount <= (1 << DebounceSettleBits) - 1,
+                  "DebounceSettleCount must fit in DebounceSettleBits bits.");
+    static_assert(DebounceSampleCount > 0, "DebounceSampleCount cannot be 0");
+    static_assert(DebounceSampleCount <= DebounceSampleBits, "DebounceSampleCount must be <= DebounceSampleBits");
+    static_assert(DebounceSettleBits > 0, "DebounceSettleBits cannot be 0");
+    static_assert(DebounceSettleBits + DebounceSampleBits <= 8, "DebounceSampleBits + DebounceSettleBits must be <=8");
+
+    static constexpr uint32_t now()
+    {
+        return 0;
+    }
+
+    template <size_t COL_COUNT, typename RowMask>
+    class Row
+    {
+    public:
+        Row()
+            : m_samples()
+            , m_settle()
+        {
+            restart(ColumnMask, 0);
+        }
+
+        void update(const RowMask sample, uint32_t, RowMask& closed_samples, RowMask& open_samples)
+        {
+            // Switches still in their settle window count down and ignore this sample. Every other switch
+            // shifts the sample into its history.
+            const RowMask settling = vertical_count_down(m_settle);
+            shift_history(m_samples, sample, settling);
+
+            RowMask all_closed = ColumnMask;
+            RowMask any_closed = 0;
+            for (size_t k = 0; k < DebounceSampleCount; ++k)
+            {
+                all_closed &= m_samples[k];
+                any_closed |= m_samples[k];
+            }
+            closed_samples = all_closed;
+            open_samples   = static_cast<RowMask>(ColumnMask & ~any_closed);
+        }
+
+        /*
+         * (Re)start the settle window for the given switches.
+         */
+        void restart(const RowMask switches, uint32_t)
+        {
+            vertical_count_load(m_settle, switches, DebounceSettleCount);
+        }
+
+        bool inFlight(const RowMask closed) const
+        {
+            RowMask unsettled = vertical_count_active(m_settle);
+            for (size_t k = 0; k < DebounceSampleCount; ++k)
+            {
+                unsettled |= static_cast<RowMask>(m_samples[k] ^ closed);
+            }
+            return (unsettled != 0);
+        }
+
+    private:
+        static constexpr const RowMask ColumnMask = column_mask<RowMask>(COL_COUNT);
+
+        // m_samples[k] holds, for each switch, the sample taken k samples ago.
+        RowMask m_samples[DebounceSampleCount];
+        // Only as many planes as DebounceSettleCount needs. DebounceSettleBits is just an upper bound.
+        static constexpr const size_t SettlePlanes =
+            (bit_width(DebounceSettleCount) > 0) ? bit_width(DebounceSettleCount) : 1;
+
+        // A vertical counter of scans left in each switch's settle window. m_settle[i] is bit i of the count.
+        RowMask m_settle[SettlePlanes];
+    };
+};
+
+// ODR definitions for when a WideRowMask ColumnMask is bound to a reference. Not needed from C++17.
+template <typename TRAITS>
+template <size_t COL_COUNT, typename RowMask>
+constexpr const RowMask CountedDebounce<TRAITS>::Row<COL_COUNT, RowMask>::ColumnMask;
+
+/**
+ * Uses single samples to determine switch state. This is the compile-time equivalent of passing false for
+ * enable_software_debounce and removes the debounce state and the runtime check.
+ */
+struct NoDebounce
+{
+    static constexpr const bool enabled = false;
+
+    static constexpr uint32_t now()
+    {
+        return 0;
+    }
+
+    template <size_t COL_COUNT, typename RowMask>
+    class Row
+    {
+    public:
+        void update(RowMask, uint32_t, RowMask&, RowMask&) {}
+
+        void restart(RowMask, uint32_t) {}
+
+        bool inFlight(RowMask) const
+        {
+            return false;
+        }
+    };
+};
+
+/**
+ * Minimum-latency policy for presses. A switch closes on the first sample that reads closed and then ignores
+ * the next LOCK_SAMPLES samples so the press bounce can't reopen it. Only releases are debounced: a switch
+ * opens after RELEASE_SAMPLES consecutive open samples and is then locked again so release bounce can't
+ * close it. Discovering a switch's initial state also starts its lock window.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::ArduinoPins,
+ *                                             gh::thirtytwobits::EagerDebounce<5, 2>> scanner(rowPins, colPins);
+ */
+template <uint8_t LOCK_SAMPLES = 4, uint8_t RELEASE_SAMPLES = 2>
+struct EagerDebounce
+{
+    static_assert(RELEASE_SAMPLES > 0, "RELEASE_SAMPLES cannot be 0");
+
+    static constexpr const bool enabled = true;
+
+    static constexpr uint32_t now()
+    {
+        return 0;
+    }
+
+    template <size_t COL_COUNT, typename RowMask>
+    class Row
+    {
+    public:
+        Row()
+            : m_samples()
+            , m_lock()
+        {}
+
+        void update(const RowMask sample, uint32_t, RowMask& closed_samples, RowMask& open_samples)
+        {
+            const RowMask locked = vertical_count_down(m_lock);
+            shift_history(m_samples, sample, locked);
+
+            RowMask any_closed = 0;
+            for (size_t k = 0; k < RELEASE_SAMPLES; ++k)
+            {
+                any_closed |= m_samples[k];
+            }
+            closed_samples = static_cast<RowMask>(m_samples[0] & ~locked);
+            open_samples   = static_cast<RowMask>(ColumnMask & ~(any_closed | locked));
+        }
+
+        void restart(const RowMask switches, uint32_t)
+        {
+            vertical_count_load(m_lock, switches, LOCK_SAMPLES);
+        }
+
+        bool inFlight(const RowMask closed) const
+        {
+            RowMask unsettled = vertical_count_active(m_lock);
+            for (size_t k = 0; k < RELEASE_SAMPLES; ++k)
+            {
+                unsettled |= static_cast<RowMask>(m_samples[k] ^ closed);
+            }
+            return (unsettled != 0);
+        }
+
+    private:
+        static constexpr const RowMask ColumnMask = column_mask<RowMask>(COL_COUNT);
+        static constexpr const size_t  LockBits   = (bit_width(LOCK_SAMPLES) > 0) ? bit_width(LOCK_SAMPLES) : 1;
+
+        // m_samples[k] holds, for each switch, the sample taken k samples ago.
+        RowMask m_samples[RELEASE_SAMPLES];
+        // Vertical counter of samples each switch ignores after a state change.
+        RowMask m_lock[LockBits];
+    };
+};
+
+template <uint8_t LOCK_SAMPLES, uint8_t RELEASE_SAMPLES>
+template <size_t COL_COUNT, typename RowMask>
+constexpr const RowMask EagerDebounce<LOCK_SAMPLES, RELEASE_SAMPLES>::Row<COL_COUNT, RowMask>::ColumnMask;
+
+/**
+ * The default clock for TimedDebounce.
+ */
+struct MicrosClock
+{
+    static uint32_t now()
+    {
+        return static_cast<uint32_t>(micros());
+    }
+};
+
+/**
+ * Debounces in real time instead of scan counts. A switch changes state once its samples have not changed for
+ * WINDOW_US microseconds so the scan rate can be lowered without changing the debounce time. The clock is read
+ * once per row.
+ *
+ * Each switch stores a 16-bit timestamp of its last sample change so scan() must be called more often than
+ * every 65 ms.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::ArduinoPins,
+ *                                             gh::thirtytwobits::TimedDebounce<5000>> scanner(rowPins, colPins);
+ */
+template <uint16_t WINDOW_US, typename CLOCK = MicrosClock>
+struct TimedDebounce
+{
+    static_assert(WINDOW_US > 0 && WINDOW_US < 0x8000, "WINDOW_US must be between 1 and 32767 microseconds.");
+
+    static constexpr const bool enabled = true;
+
+    static uint32_t now()
+    {
+        return CLOCK::now();
+    }
+
+    template <size_t COL_COUNT, typename RowMask>
+    class Row
+    {
+    public:
+        Row()
+            : m_last_sample(0)
+            , m_stable(0)
+            , m_started(false)
+            , m_changed_at()
+        {}
+
+        void update(const RowMask sample, const uint32_t now, RowMask& closed_samples, RowMask& open_samples)
+        {
+            const uint16_t timestamp = static_cast<uint16_t>(now);
+            RowMask        changed   = static_cast<RowMask>(sample ^ m_last_sample);
+            if (!m_started)
+            {
+                changed   = ColumnMask;
+                m_started = true;
+            }
+            m_last_sample = sample;
+            m_stable      = static_cast<RowMask>(m_stable & ~changed);
+            while (changed != 0)
+            {
+                const uint8_t c = lowest_column(changed);
+                m_changed_at[c] = timestamp;
+                changed         = static_cast<RowMask>(changed & ~column_bit<RowMask>(c));
+            }
+            RowMask waiting = static_cast<RowMask>(ColumnMask & ~m_stable);
+            while (waiting != 0)
+            {
+                const uint8_t c   = lowest_column(waiting);
+                const RowMask bit = column_bit<RowMask>(c);
+                waiting           = static_cast<RowMask>(waiting & ~bit);
+                if (static_cast<uint16_t>(timestamp - m_changed_at[c]) >= WINDOW_US)
+                {
+                    m_stable = static_cast<RowMask>(m_stable | bit);
+                }
+            }
+            closed_samples = static_cast<RowMask>(m_stable & m_last_sample);
+            open_samples   = static_cast<RowMask>(m_stable & ~m_last_sample);
+        }
+
+        void restart(RowMask, uint32_t) {}
+
+        bool inFlight(const RowMask closed) const
+        {
+            return (m_stable != ColumnMask) || (m_last_sample != closed);
+        }
+
+    private:
+        static constexpr const RowMask ColumnMask = column_mask<RowMask>(COL_COUNT);
+
+        RowMask  m_last_sample;
+        RowMask  m_stable;
+        bool     m_started;
+        uint16_t m_changed_at[COL_COUNT];
+    };
+};
+
+template <uint16_t WINDOW_US, typename CLOCK>
+template <size_t COL_COUNT, typename RowMask>
+constexpr const RowMask TimedDebounce<WINDOW_US, CLOCK>::Row<COL_COUNT, RowMask>::ColumnMask;
+
+// +--------------------------------------------------------------------------+
+// | ADAPTIVE SCAN RATE
+// +--------------------------------------------------------------------------+
+/**
+ * One step of an adaptive scan rate. See SwitchMatrixScanner::setAdaptiveScanRate.
+ */
+struct ScanRateStep
+{
+    // Consecutive quiet frames before this step applies.
+    uint16_t quiet_frames;
+    // Scan once every this many calls (1 is every call).
+    uint8_t divider;
+};
+
+// +--------------------------------------------------------------------------+
+// | SCAN STATISTICS POLICIES
+// +--------------------------------------------------------------------------+
+/**
+ * What a statistics policy reports. Times are in ticks of the policy's clock (see ScanTimingStats).
+ */
+struct ScanStats
+{
+    // Completed calls to scan(), including the single-read scans made while idle.
+    uint32_t scans;
+    // Duration of scan() calls. These include the time spent in SwitchHandlers.
+    uint32_t scan_min;
+    uint32_t scan_max;
+    uint32_t scan_mean;
+    // Total time spent inside SwitchHandler callbacks.
+    uint32_t handler_total;
+    // How often a SwitchHandler was called before the end of a scan because EVENT_BUFFER_SIZE filled up.
+    uint32_t mid_scan_flushes;
+    // Shortest and longest time between the start of consecutive scans. The difference is the jitter.
+    uint32_t period_min;
+    uint32_t period_max;
+    // Calls to scan() that returned without scanning because the adaptive scan rate was decimating.
+    uint32_t skipped_scans;
+};
+
+/**
+ * Statistics policies are given to the SwitchMatrixScanner as its STATS parameter. A policy is a class
+ * providing:
+ *
+ *      void      begin();         // called from SwitchMatrixScanner::setup
+ *      void      reset();
+ *      void      scanBegin();
+ *      void      scanEnd();
+ *      void      handlerBegin();  // around each SwitchHandler call
+ *      void      handlerEnd();
+ *      void      midScanFlush();
+ *      void      scanSkipped();   // instead of scanBegin/scanEnd for calls skipped by the adaptive scan rate
+ *      ScanStats get() const;
+ *
+ *      // After each row that wasn't skipped by the fast path is sampled and debounced. reported holds the
+ *      // switches whose events were sent and in_flight is true while the row still has debouncing to do.
+ *      template <typename RowMask>
+ *      void rowUpdated(size_t row, RowMask sample, RowMask previous_sample, RowMask closed, RowMask reported,
+ *                      bool in_flight);
+ *
+ * NoScanStats is the default. It is empty and all its methods are empty so it compiles to nothing.
+ */
+struct NoScanStats
+{
+    void begin() {}
+    void reset() {}
+    void scanBegin() {}
+    void scanEnd() {}
+    void handlerBegin() {}
+    void handlerEnd() {}
+    void midScanFlush() {}
+    void scanSkipped() {}
+
+    template <typename RowMask>
+    void rowUpdated(size_t, RowMask, RowMask, RowMask, RowMask, bool)
+    {}
+
+    ScanStats get() const
+    {
+        return ScanStats();
+    }
+};
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+/**
+ * Counts CPU cycles using the DWT cycle counter found on Cortex-M3, M4, M7 and M33 parts.
+ */
+struct CycleCounterClock
+{
+    static void begin()
+    {
+        // Enable trace (DEMCR.TRCENA), unlock the DWT (DWT_LAR, needed on Cortex-M7 where writes to DWT_CTRL
+        // are ignored until then and write-ignored elsewhere) and then enable the cycle counter
+        // (DWT_CTRL.CYCCNTENA).
+        *reinterpret_cast<volatile uint32_t*>(0xE000EDFCUL) |= (1UL << 24);
+        *reinterpret_cast<volatile uint32_t*>(0xE0001FB0UL) = 0xC5ACCE55UL;
+        *reinterpret_cast<volatile uint32_t*>(0xE0001000UL) |= 1UL;
+    }
+
+    static uint32_t now()
+    {
+        return *reinterpret_cast<volatile uint32_t*>(0xE0001004UL);
+    }
+};
+
+using DefaultStatsClock = CycleCounterClock;
+#else
+/**
+ * Counts microseconds where there is no cycle counter.
+ */
+struct MicrosStatsClock : MicrosClock
+{
+    static void begin() {}
+};
+
+using DefaultStatsClock = MicrosStatsClock;
+#endif
+
+/**
+ * Records scan durations, time spent in SwitchHandlers, mid-scan flushes, and scan period jitter. The
+ * default clock counts CPU cycles on Cortex-M parts with a DWT cycle counter and microseconds everywhere
+ * else. A CLOCK provides `static void begin()` and `static uint32_t now()`.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::ArduinoPins,
+ *                                             gh::thirtytwobits::CountedDebounce<>,
+ *                                             gh::thirtytwobits::ScanTimingStats<>> scanner(rowPins, colPins);
+ *
+ *      const gh::thirtytwobits::ScanStats stats = scanner.getStats();
+ */
+template <typename CLOCK = DefaultStatsClock>
+class ScanTimingStats
+{
+public:
+    ScanTimingStats()
+        : m_stats()
+        , m_scan_total(0)
+        , m_scan_start(0)
+        , m_handler_start(0)
+    {
+        reset();
+    }
+
+    void begin()
+    {
+        CLOCK::begin();
+        reset();
+    }
+
+    void reset()
+    {
+        m_stats            = ScanStats();
+        m_stats.scan_min   = NoSample;
+        m_stats.period_min = NoSample;
+        m_scan_total       = 0;
+    }
+
+    void scanBegin()
+    {
+        const uint32_t now = CLOCK::now();
+        if (m_stats.scans > 0)
+        {
+            const uint32_t period = now - m_scan_start;
+            m_stats.period_min    = (period < m_stats.period_min) ? period : m_stats.period_min;
+            m_stats.period_max    = (period > m_stats.period_max) ? period : m_stats.period_max;
+        }
+        m_scan_start = now;
+    }
+
+    void scanEnd()
+    {
+        const uint32_t duration = CLOCK::now() - m_scan_start;
+        m_stats.scan_min        = (duration < m_stats.scan_min) ? duration : m_stats.scan_min;
+        m_stats.scan_max        = (duration > m_stats.scan_max) ? duration : m_stats.scan_max;
+        m_scan_total += duration;
+        ++m_stats.scans;
+    }
+
+    void handlerBegin()
+    {
+        m_handler_start = CLOCK::now();
+    }
+
+    void handlerEnd()
+    {
+        m_stats.handler_total += CLOCK::now() - m_handler_start;
+    }
+
+    void midScanFlush()
+    {
+        ++m_stats.mid_scan_flushes;
+    }
+
+    void scanSkipped()
+    {
+        ++m_stats.skipped_scans;
+    }
+
+    template <typename RowMask>
+    void rowUpdated(size_t, RowMask, RowMask, RowMask, RowMask, bool)
+    {}
+
+    ScanStats get() const
+    {
+        ScanStats stats = m_stats;
+        if (stats.scans == 0)
+        {
+            stats.scan_min = 0;
+        }
+        else
+        {
+            stats.scan_mean = static_cast<uint32_t>(m_scan_total / stats.scans);
+        }
+        if (stats.scans < 2)
+        {
+            stats.period_min = 0;
+        }
+        return stats;
+    }
+
+private:
+    static constexpr const uint32_t NoSample = 0xFFFFFFFFUL;
+
+    ScanStats m_stats;
+    // 64 bits so the mean doesn't overflow on fast clocks.
+    uint64_t m_scan_total;
+    uint32_t m_scan_start;
+    uint32_t m_handler_start;
+};
+
+/**
+ * Per-switch debounce telemetry for finding worn switches and tuning debounce settings from field data. Wraps
+ * another statistics policy (NoScanStats by default) and adds, for every switch:
+ *
+ *  - bounces: how often its sample returned to the committed state without the debounce policy committing
+ *    the change. A little is normal; a switch that keeps climbing is chattering.
+ *  - settle_max: the most samples of its row between the sample first leaving the committed state and the
+ *    change being reported.
+ *
+ * plus a histogram of settle times over all switches. Settle times are in samples of the switch's row, which
+ * is scans when scanning whole frames at a regular rate. Costs about five bytes of RAM per switch.
+ *
+ * Example:
+ *
+ *      using Telemetry = gh::thirtytwobits::SwitchTelemetryStats<ROWS, COLS>;
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS, 10, gh::thirtytwobits::ArduinoPins,
+ *                                             gh::thirtytwobits::CountedDebounce<>, Telemetry> scanner(rowPins,
+ *                                                                                                      colPins);
+ *
+ *      Telemetry::SwitchReport worst[4];
+ *      const size_t worst_len = scanner.getStatsPolicy().getWorstSwitches(worst, 4);
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT, typename BASE = NoScanStats>
+class SwitchTelemetryStats : public BASE
+{
+public:
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    /**
+     * Settle time histogram buckets. Bucket 0 counts changes reported on the first sample, bucket b counts
+     * those that took from 2^(b-1) to 2^b - 1 samples and the last bucket counts everything longer.
+     */
+    static constexpr const size_t settle_buckets = 8;
+
+    struct SwitchReport
+    {
+        ScanCodeType scancode;
+        uint16_t     bounces;
+        uint8_t      settle_max;
+    };
+
+    SwitchTelemetryStats()
+        : BASE()
+        , m_row_samples()
+        , m_pending()
+        , m_settle_start()
+        , m_bounces()
+        , m_settle_max()
+        , m_settle_histogram()
+    {}
+
+    void begin()
+    {
+        BASE::begin();
+        clear();
+    }
+
+    void reset()
+    {
+        BASE::reset();
+        clear();
+    }
+
+    void rowUpdated(const size_t  row,
+                    const RowMask sample,
+                    const RowMask previous_sample,
+                    const RowMask closed,
+                    const RowMask reported,
+                    const bool    in_flight)
+    {
+        const uint16_t now    = ++m_row_samples[row];
+        RowMask        settle = reported;
+        while (settle != 0)
+        {
+            const uint8_t  c     = lowest_column(settle);
+            const RowMask  bit   = column_bit<RowMask>(c);
+            const size_t   index = row * COL_COUNT + c;
+            const bool     timed = ((m_pending[row] & bit) != 0);
+            const uint16_t took  = timed ? static_cast<uint16_t>(now - m_settle_start[index]) : 0;
+            const uint8_t  max   = static_cast<uint8_t>((took < 0xFF) ? took : 0xFF);
+            settle               = static_cast<RowMask>(settle & ~bit);
+            m_settle_max[index]  = (max > m_settle_max[index]) ? max : m_settle_max[index];
+            ++m_settle_histogram[settle_bucket(took)];
+        }
+        // Samples that went back to the committed state without anything being reported.
+        RowMask bounced = static_cast<RowMask>((sample ^ previous_sample) & ~(sample ^ closed) & ~reported);
+        while (bounced != 0)
+        {
+            const uint8_t c = lowest_column(bounced);
+            bounced         = static_cast<RowMask>(bounced & ~column_bit<RowMask>(c));
+            uint16_t& count = m_bounces[row * COL_COUNT + c];
+            count           = (count < 0xFFFF) ? static_cast<uint16_t>(count + 1) : count;
+        }
+        // Start timing switches that just left the committed state. A row that has finished debouncing has
+        // nothing left to time.
+        const RowMask departed = in_flight ? static_cast<RowMask>((sample ^ closed) & ~reported) : 0;
+        RowMask       starting = static_cast<RowMask>(departed & ~m_pending[row]);
+        m_pending[row]         = in_flight ? static_cast<RowMask>((m_pending[row] | departed) & ~reported) : 0;
+        while (starting != 0)
+        {
+            const uint8_t c = lowest_column(starting);
+            starting        = static_cast<RowMask>(starting & ~column_bit<RowMask>(c));
+            // The first sample that differed was this one.
+            m_settle_start[row * COL_COUNT + c] = static_cast<uint16_t>(now - 1);
+        }
+    }
+
+    uint16_t getBounceCount(const ScanCodeType scancode) const
+    {
+        return (scancode > 0 && scancode <= SwitchCount) ? m_bounces[scancode - 1] : 0;
+    }
+
+    uint8_t getSettleMax(const ScanCodeType scancode) const
+    {
+        return (scancode > 0 && scancode <= SwitchCount) ? m_settle_max[scancode - 1] : 0;
+    }
+
+    /**
+     * The settle time histogram. See settle_buckets.
+     */
+    const uint32_t (&getSettleHistogram() const)[settle_buckets]
+    {
+        return m_settle_histogram;
+    }
+
+    /**
+     * Writes up to max_reports switches with the most bounces, worst first. Switches that never bounced
+     * are left out.
+     *
+     * @return The number of reports written.
+     */
+    size_t getWorstSwitches(SwitchReport* const reports, const size_t max_reports) const
+    {
+        size_t reports_len = 0;
+        for (size_t i = 0; i < SwitchCount; ++i)
+        {
+            if (m_bounces[i] == 0)
+            {
+                continue;
+            }
+            // Insertion into the sorted reports, dropping whatever falls off the end.
+            size_t at = (reports_len < max_reports) ? reports_len++ : max_reports;
+            while (at > 0 && reports[at - 1].bounces < m_bounces[i])
+            {
+                if (at < max_reports)
+                {
+                    reports[at] = reports[at - 1];
+                }
+                --at;
+            }
+            if (at < max_reports)
+            {
+                reports[at] = SwitchReport{static_cast<ScanCodeType>(i + 1), m_bounces[i], m_settle_max[i]};
+            }
+        }
+        return reports_len;
+    }
+
+private:
+    static constexpr const size_t SwitchCount = ROW_COUNT * COL_COUNT;
+
+    static size_t settle_bucket(uint16_t samples)
+    {
+        size_t bucket = 0;
+        while (samples != 0 && bucket < settle_buckets - 1)
+        {
+            samples = static_cast<uint16_t>(samples >> 1);
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void clear()
+    {
+        memset(m_pending, 0, sizeof(m_pending));
+        memset(m_bounces, 0, sizeof(m_bounces));
+        memset(m_settle_max, 0, sizeof(m_settle_max));
+        memset(m_settle_histogram, 0, sizeof(m_settle_histogram));
+    }
+
+    // Samples taken of each row. Free-running so settle times are differences.
+    uint16_t m_row_samples[ROW_COUNT];
+    // Switches whose sample left the committed state and haven't been reported yet.
+    RowMask  m_pending[ROW_COUNT];
+    uint16_t m_settle_start[SwitchCount];
+    uint16_t m_bounces[SwitchCount];
+    uint8_t  m_settle_max[SwitchCount];
+    uint32_t m_settle_histogram[settle_buckets];
+};
+
+// +--------------------------------------------------------------------------+
+// | EVENTS
+// +--------------------------------------------------------------------------+
+/**
+ * Which way a switch changed.
+ */
+enum class SwitchEdge : uint8_t
+{
+    OPENED = 0,
+    CLOSED = 1
+};
+
+/**
+ * A single switch state change.
+ */
+struct SwitchEvent
+{
+    ScanCodeType scancode;
+    SwitchEdge   edge;
+};
+
+/**
+ * When SwitchMatrixScanner::scanRows calls the SwitchHandlers.
+ */
+enum class SliceEventDelivery : uint8_t
+{
+    // At the end of every scanRows call.
+    PER_SLICE = 0,
+    // Only once a call completes the frame (or when EVENT_BUFFER_SIZE fills up).
+    PER_FRAME = 1
+};
+
+/**
+ * Single-producer/single-consumer lock-free queue of SwitchEvents. Pass one to SwitchMatrixScanner::scan
+ * from a timer interrupt (the producer) and drain it with poll from loop() (the consumer).
+ *
+ * If the ring is full the scanner does not drop events. The affected switches are left uncommitted and are
+ * reported by a later scan once there is room.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchEventRing<16> events;
+ *
+ *      SWITCH_MATRIX_SCAN_TIMER_ISR()
+ *      {
+ *          scanner.scan(events);
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::SwitchEvent batch[8];
+ *          const size_t batch_len = events.poll(batch, 8);
+ *          ...
+ *      }
+ */
+template <size_t CAPACITY>
+class SwitchEventRing final
+{
+public:
+    static constexpr size_t capacity = CAPACITY;
+
+    SwitchEventRing()
+        : m_events()
+        , m_head(0)
+        , m_tail(0)
+    {}
+
+    SwitchEventRing(const SwitchEventRing&)  = delete;
+    SwitchEventRing(const SwitchEventRing&&) = delete;
+    SwitchEventRing& operator=(const SwitchEventRing&) = delete;
+    SwitchEventRing& operator=(const SwitchEventRing&&) = delete;
+
+    /**
+     * Producer only. Number of events that can be pushed right now.
+     */
+    size_t room() const
+    {
+        return CAPACITY - static_cast<IndexType>(m_head - m_tail);
+    }
+
+    /**
+     * Producer only.
+     * @return false if the ring was full.
+     */
+    bool push(const SwitchEvent& event)
+    {
+        const IndexType head = m_head;
+        if (static_cast<IndexType>(head - m_tail) == CAPACITY)
+        {
+            return false;
+        }
+        m_events[head & IndexMask] = event;
+        // The event must be written before the consumer can see the new head.
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        m_head = static_cast<IndexType>(head + 1);
+        return true;
+    }
+
+    /**
+     * Consumer only. Copies up to max_events of the oldest events out of the ring.
+     * @return The number of events copied.
+     */
+    size_t poll(SwitchEvent* events, size_t max_events)
+    {
+        IndexType       tail      = m_tail;
+        const IndexType available = static_cast<IndexType>(m_head - tail);
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        const size_t count = (available < max_events) ? available : max_events;
+        for (size_t i = 0; i < count; ++i)
+        {
+            events[i] = m_events[tail & IndexMask];
+            tail      = static_cast<IndexType>(tail + 1);
+        }
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        m_tail = tail;
+        return count;
+    }
+
+    /**
+     * Consumer only.
+     */
+    bool empty() const
+    {
+        return (m_head == m_tail);
+    }
+
+private:
+    // One byte indices so reads and writes are atomic on 8-bit MCUs. The free-running difference of the two
+    // indices is the fill level which is why CAPACITY must be a power of two no larger than 128.
+    using IndexType = uint8_t;
+
+    static_assert(CAPACITY > 0 && CAPACITY <= 128, "CAPACITY must be between 1 and 128");
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    static constexpr const IndexType IndexMask = CAPACITY - 1;
+
+    SwitchEvent        m_events[CAPACITY];
+    volatile IndexType m_head;
+    volatile IndexType m_tail;
+};
+
+// +--------------------------------------------------------------------------+
+// | SCANCODE MAPS
+// +--------------------------------------------------------------------------+
+/**
+ * An optional table that replaces the scanner's scancodes with your own, for example to number the switches
+ * in the order of the physical layout or to leave gaps for positions that aren't populated. The scanner itself
+ * never stores scancodes so the table costs nothing unless you use it. On AVR it must be in PROGMEM.
+ *
+ * Example:
+ *
+ *      // One entry per matrix position in scanner scancode order. 0 drops the position.
+ *      const gh::thirtytwobits::ScanCodeType layout[ROWS * COLS] PROGMEM = {1, 2, 3, 0, ...};
+ *
+ *      gh::thirtytwobits::ScanCodeMap<ROWS, COLS> keymap(layout);
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::SwitchEvent events[8];
+ *          const size_t events_len = keymap.apply(events, scanner.scan(events, 8));
+ *          ...
+ *      }
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT>
+class ScanCodeMap final
+{
+public:
+    explicit ScanCodeMap(const ScanCodeType (&table)[ROW_COUNT * COL_COUNT])
+        : m_table(table)
+    {}
+
+    /**
+     * The table entry for a scanner scancode, or 0 if the scancode is out of range.
+     */
+    ScanCodeType operator()(const ScanCodeType scancode) const
+    {
+        if (scancode == 0 || scancode > ROW_COUNT * COL_COUNT)
+        {
+            return 0;
+        }
+        return read_scancode_table(m_table, scancode - 1);
+    }
+
+    /**
+     * Rewrites the scancodes of events in place, keeping their order and removing the events that map to 0.
+     *
+     * @return The number of events left.
+     */
+    size_t apply(SwitchEvent* const events, const size_t events_len) const
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < events_len; ++i)
+        {
+            const ScanCodeType mapped = (*this)(events[i].scancode);
+            if (mapped != 0)
+            {
+                events[kept++] = SwitchEvent{mapped, events[i].edge};
+            }
+        }
+        return kept;
+    }
+
+private:
+    const ScanCodeType* m_table;
+};
+
+// +--------------------------------------------------------------------------+
+// | STATE SNAPSHOTS
+// +--------------------------------------------------------------------------+
+/**
+ * A copy of the closed state of every switch. Bit c of closed[r] is set if the switch at row r, column c is
+ * CLOSED. Compare two of them to find what changed in between.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT>
+struct SwitchStateBitmap
+{
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    RowMask closed[ROW_COUNT];
+
+    /**
+     * Takes scanner scancodes. False for scancodes out of range.
+     */
+    bool isSwitchClosed(const ScanCodeType scancode) const
+    {
+        if (scancode == 0 || scancode > ROW_COUNT * COL_COUNT)
+        {
+            return false;
+        }
+        const size_t scanindex = scancode - 1;
+        const size_t row       = scanindex / COL_COUNT;
+        return ((closed[row] & column_bit<RowMask>(scanindex - row * COL_COUNT)) != 0);
+    }
+
+    /**
+     * The switches CLOSED in this state that were OPEN in previous.
+     */
+    SwitchStateBitmap pressedSince(const SwitchStateBitmap& previous) const
+    {
+        SwitchStateBitmap pressed;
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            pressed.closed[r] = static_cast<RowMask>(closed[r] & ~previous.closed[r]);
+        }
+        return pressed;
+    }
+
+    /**
+     * The switches OPEN in this state that were CLOSED in previous.
+     */
+    SwitchStateBitmap releasedSince(const SwitchStateBitmap& previous) const
+    {
+        SwitchStateBitmap released;
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            released.closed[r] = static_cast<RowMask>(previous.closed[r] & ~closed[r]);
+        }
+        return released;
+    }
+
+    /**
+     * True if any bit is set.
+     */
+    bool any() const
+    {
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            if (closed[r] != 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Writes the scancodes of up to max_scancodes set bits in scancode order.
+     *
+     * @return The number of scancodes written.
+     */
+    size_t scancodes(ScanCodeType* const scancodes, const size_t max_scancodes) const
+    {
+        size_t scancodes_len = 0;
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            for (RowMask pending = closed[r]; pending != 0 && scancodes_len < max_scancodes;
+                 pending         = clear_lowest_column(pending))
+            {
+                scancodes[scancodes_len++] = static_cast<ScanCodeType>(r * COL_COUNT + lowest_column(pending) + 1);
+            }
+        }
+        return scancodes_len;
+    }
+};
+
+/**
+ * Double-buffered switch state for sketches that would rather not have callbacks run from inside the scan.
+ * Pass one to SwitchMatrixScanner::scan, possibly from a timer interrupt (the producer), and read it from
+ * loop() (the consumer) at whatever pace suits the sketch. The producer always writes the buffer the consumer
+ * isn't reading and swaps them by bumping a one byte sequence number, so it never waits. The consumer copies
+ * the current buffer and tries again if the producer published more than once while it was copying, so every
+ * copy is a complete scan.
+ *
+ * Example:
+ *
+ *      gh::thirtytwobits::SwitchStateSnapshot<ROWS, COLS> switches;
+ *
+ *      SWITCH_MATRIX_SCAN_TIMER_ISR()
+ *      {
+ *          scanner.scan(switches);
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          static decltype(switches)::Bitmap previous = {};
+ *          decltype(switches)::Bitmap        current;
+ *          if (switches.read(current))
+ *          {
+ *              const auto pressed  = current.pressedSince(previous);
+ *              const auto released = current.releasedSince(previous);
+ *              previous            = current;
+ *              ...
+ *          }
+ *      }
+ *
+ * Only the latest state is kept, so a switch that closes and opens again between two reads is never seen.
+ * Use a SwitchEventRing if every change matters.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT>
+class SwitchStateSnapshot final
+{
+public:
+    using Bitmap = SwitchStateBitmap<ROW_COUNT, COL_COUNT>;
+
+    SwitchStateSnapshot()
+        : m_buffers()
+        , m_sequence(0)
+        , m_read_sequence(0)
+    {}
+
+    SwitchStateSnapshot(const SwitchStateSnapshot&)  = delete;
+    SwitchStateSnapshot(const SwitchStateSnapshot&&) = delete;
+    SwitchStateSnapshot& operator=(const SwitchStateSnapshot&) = delete;
+    SwitchStateSnapshot& operator=(const SwitchStateSnapshot&&) = delete;
+
+    /**
+     * Producer only. Copies the scanner's closed bitmap into the spare buffer and makes it current.
+     * SwitchMatrixScanner::scan does this whenever a scan changes something.
+     */
+    template <typename SCANNER>
+    void publish(const SCANNER& scanner)
+    {
+        static_assert(SCANNER::row_count == ROW_COUNT && SCANNER::col_count == COL_COUNT,
+                      "The snapshot must match the scanner's dimensions.");
+        const uint8_t next = static_cast<uint8_t>(m_sequence + 1);
+        scanner.getClosedBitmap(m_buffers[next & 1].closed);
+        // The buffer must be written before the consumer can see the new sequence number.
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        m_sequence = next;
+    }
+
+    /**
+     * Consumer only. Copies the latest published state.
+     *
+     * @return true if anything was published since the last read.
+     */
+    bool read(Bitmap& state)
+    {
+        uint8_t sequence;
+        uint8_t after;
+        do
+        {
+            sequence = m_sequence;
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+            state = m_buffers[sequence & 1];
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+            after = m_sequence;
+            // One publish during the copy went to the other buffer. A second one may have overwritten this one.
+        } while (static_cast<uint8_t>(after - sequence) > 1);
+        const bool fresh = (sequence != m_read_sequence);
+        m_read_sequence  = sequence;
+        return fresh;
+    }
+
+private:
+    Bitmap           m_buffers[2];
+    volatile uint8_t m_sequence;
+    uint8_t          m_read_sequence;
+};
+
+// +--------------------------------------------------------------------------+
+// | EVENT SINKS
+// +--------------------------------------------------------------------------+
+/**
+ * SwitchMatrixScanner and AnalogSwitchMatrixScanner hand the events they find to a sink. A sink provides:
+ *
+ *      size_t room() const;                                 // events that can be accepted right now
+ *      void   push(ScanCodeType scancode, SwitchEdge edge); // called in scan order
+ *      void   finish();                                     // called at the end of each scan or slice
+ *
+ * Switch changes that don't fit are left uncommitted and are reported by a later scan. Both scanners use the
+ * sinks below so events are batched, flushed and deferred the same way no matter which one found them.
+ */
+
+/**
+ * The SwitchHandler path. Closed and opened scancodes are batched separately and flushed early if a buffer
+ * fills. At the end of a scan the closes are flushed before the opens.
+ *
+ * @tparam EVENT_BUFFER_SIZE  The size of the buffers handed to the handlers.
+ * @tparam STATS              Told about every handler call and early flush (see ScanTimingStats).
+ */
+template <size_t EVENT_BUFFER_SIZE, typename STATS = NoScanStats>
+class SwitchHandlerQueue final
 {
-    UNKNOWN = 0,
-    OPEN    = 1,
-    CLOSED  = 2
+public:
+    using SwitchHandler = void (*)(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], size_t scancodes_len, void* userdata);
+
+    explicit SwitchHandlerQueue(STATS& stats)
+        : m_stats(stats)
+        , m_switchhandler_closed(nullptr)
+        , m_switchhandler_open(nullptr)
+        , m_switchhandler_userdata(nullptr)
+        , m_scancode_event_buffer_opened{0}
+        , m_scancode_event_buffer_opened_len(0)
+        , m_scancode_event_buffer_closed{0}
+        , m_scancode_event_buffer_closed_len(0)
+    {}
+
+    SwitchHandlerQueue(const SwitchHandlerQueue&)  = delete;
+    SwitchHandlerQueue(const SwitchHandlerQueue&&) = delete;
+    SwitchHandlerQueue& operator=(const SwitchHandlerQueue&) = delete;
+    SwitchHandlerQueue& operator=(const SwitchHandlerQueue&&) = delete;
+
+    /**
+     * The function pointers SetupHandlers calls. Either may be nullptr.
+     */
+    void setHandlers(SwitchHandler switchclosed_handler, SwitchHandler switchopen_handler, void* userdata)
+    {
+        m_switchhandler_closed   = switchclosed_handler;
+        m_switchhandler_open     = switchopen_handler;
+        m_switchhandler_userdata = userdata;
+    }
+
+    /**
+     * Handlers that call the function pointers given to setHandlers.
+     */
+    class SetupHandlers
+    {
+    public:
+        explicit SetupHandlers(SwitchHandlerQueue& queue)
+            : m_queue(queue)
+        {}
+
+        void closed(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], const size_t scancodes_len)
+        {
+            m_queue.call(m_queue.m_switchhandler_closed, scancodes, scancodes_len);
+        }
+
+        void opened(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], const size_t scancodes_len)
+        {
+            m_queue.call(m_queue.m_switchhandler_open, scancodes, scancodes_len);
+        }
+
+    private:
+        SwitchHandlerQueue& m_queue;
+    };
+
+    /**
+     * Handlers that call the given callables directly so they can be inlined.
+     */
+    template <typename CLOSED_HANDLER, typename OPEN_HANDLER>
+    class CallableHandlers
+    {
+    public:
+        CallableHandlers(STATS& stats, CLOSED_HANDLER& closed_handler, OPEN_HANDLER& open_handler)
+            : m_stats(stats)
+            , m_closed_handler(closed_handler)
+            , m_open_handler(open_handler)
+        {}
+
+        void closed(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], const size_t scancodes_len)
+        {
+            m_stats.handlerBegin();
+            m_closed_handler(scancodes, scancodes_len);
+            m_stats.handlerEnd();
+        }
+
+        void opened(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], const size_t scancodes_len)
+        {
+            m_stats.handlerBegin();
+            m_open_handler(scancodes, scancodes_len);
+            m_stats.handlerEnd();
+        }
+
+    private:
+        STATS&          m_stats;
+        CLOSED_HANDLER& m_closed_handler;
+        OPEN_HANDLER&   m_open_handler;
+    };
+
+    struct NoHandler
+    {
+        void operator()(const ScanCodeType (&)[EVENT_BUFFER_SIZE], size_t) const {}
+    };
+
+    /**
+     * The sink for this queue. HANDLERS provides closed(scancodes, scancodes_len) and
+     * opened(scancodes, scancodes_len).
+     */
+    template <typename HANDLERS>
+    class Sink
+    {
+    public:
+        Sink(SwitchHandlerQueue& queue, HANDLERS& handlers)
+            : m_queue(queue)
+            , m_handlers(handlers)
+        {}
+
+        // The buffers are flushed as they fill so there is always room.
+        static constexpr size_t room()
+        {
+            return static_cast<size_t>(-1);
+        }
+
+        void push(const ScanCodeType scancode, const SwitchEdge edge)
+        {
+            m_queue.queueEvent(scancode, edge, m_handlers);
+        }
+
+        void finish()
+        {
+            m_queue.flush_closed_events(m_handlers);
+            m_queue.flush_opened_events(m_handlers);
+        }
+
+    private:
+        SwitchHandlerQueue& m_queue;
+        HANDLERS&           m_handlers;
+    };
+
+private:
+    void call(const SwitchHandler handler, const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], const size_t scancodes_len)
+    {
+        if (handler != nullptr)
+        {
+            m_stats.handlerBegin();
+            handler(scancodes, scancodes_len, m_switchhandler_userdata);
+            m_stats.handlerEnd();
+        }
+    }
+
+    /*
+     * Adds an event to the buffers, flushing them early if they fill up.
+     */
+    template <typename HANDLERS>
+    void queueEvent(const ScanCodeType scancode, const SwitchEdge edge, HANDLERS& handlers)
+    {
+        if (edge == SwitchEdge::CLOSED)
+        {
+            m_scancode_event_buffer_closed[m_scancode_event_buffer_closed_len++] = scancode;
+        }
+        else
+        {
+            m_scancode_event_buffer_opened[m_scancode_event_buffer_opened_len++] = scancode;
+        }
+        if (m_scancode_event_buffer_closed_len == EVENT_BUFFER_SIZE)
+        {
+            // We're about to overrun our event buffer so we'll have to flush
+            // before we're done scanning.
+            m_stats.midScanFlush();
+            flush_closed_events(handlers);
+        }
+        if (m_scancode_event_buffer_opened_len == EVENT_BUFFER_SIZE)
+        {
+            // We're about to overrun our event buffer so we'll have to flush
+            // before we're done scanning.
+            m_stats.midScanFlush();
+            flush_opened_events(handlers);
+        }
+    }
+
+    template <typename HANDLERS>
+    void flush_opened_events(HANDLERS& handlers)
+    {
+        if (m_scancode_event_buffer_opened_len > 0)
+        {
+            handlers.opened(m_scancode_event_buffer_opened, m_scancode_event_buffer_opened_len);
+            m_scancode_event_buffer_opened_len = 0;
+        }
+    }
+
+    template <typename HANDLERS>
+    void flush_closed_events(HANDLERS& handlers)
+    {
+        if (m_scancode_event_buffer_closed_len > 0)
+        {
+            handlers.closed(m_scancode_event_buffer_closed, m_scancode_event_buffer_closed_len);
+            m_scancode_event_buffer_closed_len = 0;
+        }
+    }
+
+    static_assert(EVENT_BUFFER_SIZE > 0, "EVENT_BUFFER_SIZE cannot be 0");
+
+    STATS&        m_stats;
+    SwitchHandler m_switchhandler_closed;
+    SwitchHandler m_switchhandler_open;
+    void*         m_switchhandler_userdata;
+    ScanCodeType  m_scancode_event_buffer_opened[EVENT_BUFFER_SIZE];
+    size_t        m_scancode_event_buffer_opened_len;
+    ScanCodeType  m_scancode_event_buffer_closed[EVENT_BUFFER_SIZE];
+    size_t        m_scancode_event_buffer_closed_len;
 };
 
-/*
- * This is used by the SwitchMatrixScanner class internally. You can ignore it.
+/**
+ * Pushes events into a SwitchEventRing.
  */
-struct SwitchDef
+template <size_t RING_CAPACITY>
+class SwitchEventRingSink final
 {
-    SwitchDef()
-        : scancode(0)
-        , state(SwitchState::UNKNOWN)
-        , sample_buffer(0)
+public:
+    explicit SwitchEventRingSink(SwitchEventRing<RING_CAPACITY>& ring)
+        : m_ring(ring)
     {}
-    ScanCodeType scancode;
-    SwitchState  state;
-    uint8_t      sample_buffer;
+
+    size_t room() const
+    {
+        return m_ring.room();
+    }
+
+    void push(const ScanCodeType scancode, const SwitchEdge edge)
+    {
+        m_ring.push(SwitchEvent{scancode, edge});
+    }
+
+    void finish() {}
+
+private:
+    SwitchEventRing<RING_CAPACITY>& m_ring;
 };
 
-/*
- * All of this is Template Meta-Programming used to initialize the SwitchMatrixScanner internals.
- * You can ignore it.
+/**
+ * Writes events into a caller's buffer.
  */
-template <size_t ROW_COUNT, size_t COL_COUNT, typename UpdateType, ScanCodeType scanindex = (ROW_COUNT * COL_COUNT) - 1>
-struct ScanCodeGenerator
+class SwitchEventBufferSink final
 {
-    static constexpr void updateScanItems(UpdateType (&scan_items)[ROW_COUNT][COL_COUNT])
+public:
+    SwitchEventBufferSink(SwitchEvent* const events, const size_t max_events)
+        : m_events(events)
+        , m_max_events(max_events)
+        , m_length(0)
+    {}
+
+    size_t room() const
+    {
+        return m_max_events - m_length;
+    }
+
+    void push(const ScanCodeType scancode, const SwitchEdge edge)
+    {
+        m_events[m_length++] = SwitchEvent{scancode, edge};
+    }
+
+    void finish() {}
+
+    size_t length() const
     {
-        scan_items[scanindex / COL_COUNT][scanindex % COL_COUNT].scancode = scanindex + 1;
-        ScanCodeGenerator<ROW_COUNT, COL_COUNT, UpdateType, scanindex-1>::updateScanItems(scan_items);
+        return m_length;
     }
+
+private:
+    SwitchEvent* const m_events;
+    const size_t       m_max_events;
+    size_t             m_length;
 };
 
-template <size_t ROW_COUNT, size_t COL_COUNT, typename UpdateType>
-struct ScanCodeGenerator<ROW_COUNT, COL_COUNT, UpdateType, 0>
+/**
+ * For scans that only update the switch state.
+ */
+struct SwitchEventDiscardSink final
 {
-    static constexpr void updateScanItems(UpdateType (&scan_items)[ROW_COUNT][COL_COUNT])
+    static constexpr size_t room()
     {
-        scan_items[0][0].scancode = 1;
+        return static_cast<size_t>(-1);
     }
-};
-};  // namespace
 
+    void push(ScanCodeType, SwitchEdge) {}
 
+    void finish() {}
+};
 
 // +--------------------------------------------------------------------------+
 // | THE MAIN CLASS :: SwitchMatrixScanner
@@ -112,8 +2633,16 @@ struct ScanCodeGenerator<ROW_COUNT, COL_COUNT, UpdateType, 0>
  *                 // support this so we'll do it in software.
  *      );
  *
+ * The optional PIN_ACCESS parameter selects how pins are driven and sampled (see ArduinoPins), DEBOUNCE
+ * selects the software debounce logic (see CountedDebounce), and STATS can record timing statistics (see
+ * ScanTimingStats).
  */
-template <size_t ROW_COUNT, size_t COL_COUNT, size_t EVENT_BUFFER_SIZE = 10>
+template <size_t ROW_COUNT,
+          size_t COL_COUNT,
+          size_t EVENT_BUFFER_SIZE = 10,
+          typename PIN_ACCESS      = ArduinoPins,
+          typename DEBOUNCE        = CountedDebounce<>,
+          typename STATS           = NoScanStats>
 class SwitchMatrixScanner final
 {
 public:
@@ -138,121 +2667,400 @@ public:
     static constexpr size_t col_count         = COL_COUNT;
 
     /**
-     * Required constructor.
-     * 
-     * @param  row_pins Array of Arduino pin ids for each row in the keyboard matrix.
-     * @param  column_pins Array of Arduino pin ids for each column in the keyboard matrix.
-     * @param  enable_pullups   If true then INPUT_PULLUPS will be used for row pins otherwise
-     *                          INPUT will be used with the expectation that the hardware has
-     *                          pullups.
-     * @param  enable_software_debounce If true then this object will track samples of switches over
-     *                          time adding some hysteresis and debouncing logic. If false then
-     *                          the class will use single samples to determine switch state.
+     * How many scanners of the same type can be idle with their wake interrupts armed at the same time.
+     */
+    static constexpr size_t max_wake_instances = 4;
+
+    /**
+     * One bit per column. Bit 0 is the first column.
+     */
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    /**
+     * Required constructor.
+     * 
+     * @param  row_pins Array of Arduino pin ids for each row in the keyboard matrix.
+     * @param  column_pins Array of Arduino pin ids for each column in the keyboard matrix.
+     * @param  enable_pullups   If true then INPUT_PULLUPS will be used for row pins otherwise
+     *                          INPUT will be used with the expectation that the hardware has
+     *                          pullups.
+     * @param  enable_software_debounce If true then this object will track samples of switches over
+     *                          time adding some hysteresis and debouncing logic. If false then
+     *                          the class will use single samples to determine switch state. Use
+     *                          NoDebounce as the DEBOUNCE parameter to make this choice at compile time.
+     */
+    SwitchMatrixScanner(const uint8_t (&row_pins)[ROW_COUNT],
+                        const uint8_t (&column_pins)[COL_COUNT],
+                        const bool enable_pullups           = true,
+                        const bool enable_software_debounce = true)
+        : m_rows()
+        , m_pins(row_pins, column_pins)
+        , m_column_input_type((enable_pullups) ? INPUT_PULLUP : INPUT)
+        , m_enable_software_debounce(enable_software_debounce)
+        , m_rate_steps(nullptr)
+        , m_preselected_at(0)
+        , m_row_settle_us(0)
+        , m_cursor(0)
+        , m_slice_event_delivery(SliceEventDelivery::PER_SLICE)
+        , m_enable_anti_ghost(false)
+        , m_enable_idle_mode(false)
+        , m_idle(false)
+        , m_wake_armed(false)
+        , m_wake_requested(false)
+        , m_slice_lookahead(false)
+        , m_row_preselected(false)
+        , m_rate_steps_len(0)
+        , m_scan_divider(1)
+        , m_skip_countdown(0)
+        , m_quiet_frames(0)
+        , m_stats()
+        , m_handler_queue(m_stats)
+    {
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            m_rows[r].in_flight = true;
+        }
+    }
+
+    ~SwitchMatrixScanner()
+    {
+        releaseWakeSlot();
+    }
+    SwitchMatrixScanner(const SwitchMatrixScanner&)  = delete;
+    SwitchMatrixScanner(const SwitchMatrixScanner&&) = delete;
+    SwitchMatrixScanner& operator=(const SwitchMatrixScanner&) = delete;
+    SwitchMatrixScanner& operator=(const SwitchMatrixScanner&&) = delete;
+
+    /**
+     * Call from within the Arduino setup function. If handlers are provided they will be invoked
+     * from within the scan method. If omitted the sketch must use the isSwitchClosed method to determine
+     * switch state.
+     */
+    void setup(SwitchHandler switchclosed_handler = nullptr, SwitchHandler switchopen_handler = nullptr, void* userdata = nullptr)
+    {
+        m_handler_queue.setHandlers(switchclosed_handler, switchopen_handler, userdata);
+        m_pins.setup(m_column_input_type);
+        m_stats.begin();
+    }
+
+    /**
+     * Call from within the Arduino loop method. When debouncing is enabled it is important to call
+     * this in a fast loop and at a regular period. Variable timing will cause weird delays to users
+     * of a keyboard where some keystrokes will be missed or will occur late.
+     * 
+     * If a frame was started by scanRows this scans the rest of it.
+     *
+     * @return true if anything changed else false.
+     */
+    bool scan()
+    {
+        SetupHandlers               handlers(m_handler_queue);
+        CallbackSink<SetupHandlers> sink(m_handler_queue, handlers);
+        return scanMatrix(sink, ROW_COUNT);
+    }
+
+    /**
+     * scan() with the given handlers instead of the ones passed to setup. A handler is anything callable as
+     *
+     *      void(const ScanCodeType (&scancodes)[event_buffer_size], size_t scancodes_len)
+     *
+     * such as a lambda or a functor. Since the handler's type is known here the compiler can inline it into
+     * the scan instead of calling through a function pointer. Capture whatever the handler needs instead of
+     * using userdata.
+     *
+     * Example:
+     *
+     *      using ScanCodes = const gh::thirtytwobits::ScanCodeType (&)[decltype(scanner)::event_buffer_size];
+     *
+     *      scanner.scanWith(
+     *          [&](ScanCodes scancodes, size_t scancodes_len) { report.pressed(scancodes, scancodes_len); },
+     *          [&](ScanCodes scancodes, size_t scancodes_len) { report.released(scancodes, scancodes_len); });
+     *
+     * @return true if anything changed else false.
+     */
+    template <typename CLOSED_HANDLER, typename OPEN_HANDLER>
+    bool scanWith(CLOSED_HANDLER&& closed_handler, OPEN_HANDLER&& open_handler)
+    {
+        CallableHandlers<CLOSED_HANDLER, OPEN_HANDLER>               handlers(m_stats, closed_handler, open_handler);
+        CallbackSink<CallableHandlers<CLOSED_HANDLER, OPEN_HANDLER>> sink(m_handler_queue, handlers);
+        return scanMatrix(sink, ROW_COUNT);
+    }
+
+    /**
+     * scanWith for sketches that don't need to know when switches open.
+     */
+    template <typename CLOSED_HANDLER>
+    bool scanWith(CLOSED_HANDLER&& closed_handler)
+    {
+        NoHandler open_handler;
+        return scanWith(closed_handler, open_handler);
+    }
+
+    /**
+     * Scans up to row_count rows starting where the last call stopped so the cost of a full scan can be spread
+     * over several calls. Call it at a regular period just like scan(). The debounce policies count or time
+     * samples per row so debouncing works the same no matter how a frame is divided.
+     *
+     * Events are passed to the SwitchHandlers as configured by setSliceEventDelivery. Idle mode is only
+     * checked at the end of a frame. While idle, every call is a complete frame.
+     *
+     * @return true if this call completed a frame.
+     */
+    bool scanRows(const size_t row_count)
+    {
+        if (row_count == 0)
+        {
+            return false;
+        }
+        SetupHandlers               handlers(m_handler_queue);
+        CallbackSink<SetupHandlers> sink(m_handler_queue, handlers);
+        scanMatrix(sink, row_count);
+        return (m_cursor == 0);
+    }
+
+    /**
+     * scanRows with the given handlers instead of the ones passed to setup. See scanWith.
+     */
+    template <typename CLOSED_HANDLER, typename OPEN_HANDLER>
+    bool scanRowsWith(const size_t row_count, CLOSED_HANDLER&& closed_handler, OPEN_HANDLER&& open_handler)
+    {
+        if (row_count == 0)
+        {
+            return false;
+        }
+        CallableHandlers<CLOSED_HANDLER, OPEN_HANDLER>               handlers(m_stats, closed_handler, open_handler);
+        CallbackSink<CallableHandlers<CLOSED_HANDLER, OPEN_HANDLER>> sink(m_handler_queue, handlers);
+        scanMatrix(sink, row_count);
+        return (m_cursor == 0);
+    }
+
+    /**
+     * scanRows for a SwitchEventRing. Events are always pushed as soon as they are found.
+     */
+    template <size_t RING_CAPACITY>
+    bool scanRows(const size_t row_count, SwitchEventRing<RING_CAPACITY>& ring)
+    {
+        if (row_count == 0)
+        {
+            return false;
+        }
+        RingSink<RING_CAPACITY> sink(ring);
+        scanMatrix(sink, row_count);
+        return (m_cursor == 0);
+    }
+
+    /**
+     * scanRows for any event sink, which lets a caller such as SwitchMatrixScanGroup see every event as it is
+     * found. A sink provides:
+     *
+     *      size_t room() const;                                 // events that can be accepted right now
+     *      void   push(ScanCodeType scancode, SwitchEdge edge); // called in scan order
+     *      void   finish();                                     // called at the end of each slice
+     *
+     * Switch changes that don't fit are left uncommitted and are reported by a later scan.
+     */
+    template <typename SINK>
+    bool scanRowsInto(const size_t row_count, SINK& sink)
+    {
+        if (row_count == 0)
+        {
+            return false;
+        }
+        scanMatrix(sink, row_count);
+        return (m_cursor == 0);
+    }
+
+    /**
+     * If enabled, a scanRows call that stops before the end of a frame leaves the next row driven so it
+     * settles while the sketch does other work, such as scanning another matrix, and the next slice starts
+     * with a read. Disabled by default since it leaves a row driven between calls.
+     */
+    void setSliceLookahead(const bool enabled)
+    {
+        m_slice_lookahead = enabled;
+    }
+
+    /**
+     * Selects whether scanRows calls the SwitchHandlers after every slice (the default) or once per
+     * frame.
+     */
+    void setSliceEventDelivery(const SliceEventDelivery delivery)
+    {
+        m_slice_event_delivery = delivery;
+    }
+
+    /**
+     * Scans the matrix and pushes events into the given ring instead of invoking the SwitchHandler
+     * callbacks. This is safe to call from a timer interrupt as long as nothing else calls scan() and the
+     * ring is only drained from the main loop. See SwitchEventRing and SwitchMatrixScanTimer.h.
+     *
+     * Note that isSwitchClosed may see a partially updated row on 8-bit MCUs while an interrupt is
+     * scanning.
+     *
+     * @return true if any events were pushed.
+     */
+    template <size_t RING_CAPACITY>
+    bool scan(SwitchEventRing<RING_CAPACITY>& ring)
+    {
+        RingSink<RING_CAPACITY> sink(ring);
+        return scanMatrix(sink, ROW_COUNT);
+    }
+
+    /**
+     * Scans the matrix and, if anything changed, publishes the new state to the given snapshot instead of
+     * invoking the SwitchHandler callbacks. Like scan(ring) this is safe to call from a timer interrupt as long
+     * as nothing else calls scan() and the snapshot is only read from the main loop.
+     *
+     * @return true if a new state was published.
+     */
+    bool scan(SwitchStateSnapshot<ROW_COUNT, COL_COUNT>& snapshot)
+    {
+        DiscardSink sink;
+        const bool  changed = scanMatrix(sink, ROW_COUNT);
+        if (changed)
+        {
+            snapshot.publish(*this);
+        }
+        return changed;
+    }
+
+    /**
+     * Scans the matrix and writes its events straight into the given buffer, in scan order with closes and
+     * opens interleaved, instead of invoking the SwitchHandler callbacks. As with a full ring, switch changes
+     * that don't fit are left uncommitted and reported by a later scan.
+     *
+     * Example:
+     *
+     *      gh::thirtytwobits::SwitchEvent events[8];
+     *      const size_t events_len = scanner.scan(events, 8);
+     *
+     * @return The number of events written.
+     */
+    size_t scan(SwitchEvent* const events, const size_t max_events)
+    {
+        BufferSink sink(events, max_events);
+        scanMatrix(sink, ROW_COUNT);
+        return sink.length();
+    }
+
+    /**
+     * Enables or disables idle mode (disabled by default). With idle mode enabled, a scan that finds every
+     * switch OPEN and nothing left to debounce drives all rows LOW at once and attaches falling-edge (or, on
+     * AVR, pin change) interrupts to the column pins. While idle, each call to scan() samples the columns once instead of
+     * scanning the matrix and full scanning resumes as soon as a column reads LOW or an interrupt fires.
+     */
+    void setIdleModeEnabled(bool enabled)
+    {
+        m_enable_idle_mode = enabled;
+        if (!enabled && m_idle)
+        {
+            exitIdle();
+        }
+    }
+
+    /**
+     * If true the matrix is idle and the sketch may put the MCU to sleep. A key press will fire one of the
+     * column interrupts and wake it as long as the selected sleep mode can be exited by a pin interrupt. See
+     * canWakeFromSleep. False again as soon as a wake interrupt fires, or if a switch was already closed when
+     * the interrupts were armed, so the next scan() leaves idle mode.
+     */
+    bool isIdle() const
+    {
+        return m_idle && !m_wake_requested;
+    }
+
+    /**
+     * False if some column pins don't support interrupts, or if more than max_wake_instances scanners of this
+     * type are idle at once. On AVR only the external interrupt pins (INT0 and INT1 on an Uno) can interrupt
+     * unless SwitchMatrixPinChangeWake.h is included, and on SAMD two columns on the same EXTINT line can't
+     * both interrupt. scan() still leaves idle mode through polling but the sketch should not sleep in
+     * this case.
+     */
+    bool canWakeFromSleep() const
+    {
+        return m_wake_armed;
+    }
+
+    /**
+     * Lowers the scan rate while the matrix is quiet. A frame is quiet when every switch is OPEN and nothing is
+     * being debounced. After steps[i].quiet_frames consecutive quiet frames only one in every steps[i].divider
+     * calls to scan() or scanRows() actually scans; the others return at once and count as quiet frames too.
+     * Any change restores the full rate at the end of the frame that found it, so debouncing always runs at
+     * the full rate but a first key press can take up to divider calls to be seen.
+     *
+     * This combines with idle mode (each scan made while idle is then a single read every divider calls) and
+     * with SwitchMatrixScanTimer (run the timer at the full rate). getScanDivider reports the current rate
+     * and the STATS policy counts skipped calls.
+     *
+     * Example:
+     *
+     *      // Every call until 100 quiet frames, then every 4th call, then every 16th call after 1000.
+     *      static const gh::thirtytwobits::ScanRateStep steps[] = {{100, 4}, {1000, 16}};
+     *      scanner.setAdaptiveScanRate(steps, 2);
+     *
+     * @param  steps      Steps in increasing order of quiet_frames. Not copied so it must outlive the
+     *                    scanner. nullptr (the default) always scans at the full rate.
+     * @param  steps_len  Number of steps, at most 255.
+     */
+    void setAdaptiveScanRate(const ScanRateStep* const steps, const size_t steps_len)
+    {
+        m_rate_steps     = (steps_len > 0) ? steps : nullptr;
+        m_rate_steps_len = static_cast<uint8_t>((steps_len < 0xFF) ? steps_len : 0xFF);
+        m_quiet_frames   = 0;
+        m_scan_divider   = 1;
+        m_skip_countdown = 0;
+    }
+
+    /**
+     * How many calls to scan() are made for each scan of the matrix at the current adaptive scan rate.
+     */
+    uint8_t getScanDivider() const
+    {
+        return m_scan_divider;
+    }
+
+    /**
+     * Enables or disables anti-ghosting (disabled by default). In a matrix without diodes, pressing three
+     * corners of a rectangle makes the fourth read as closed too. With anti-ghosting enabled a new press is
+     * not reported while its row shares two or more closed columns with another row. It is reported once
+     * the ambiguity is gone (for example when one of the other switches is released).
+     */
+    void setAntiGhostEnabled(const bool enabled)
+    {
+        m_enable_anti_ghost = enabled;
+    }
+
+    /**
+     * Sets the minimum time between driving a row LOW and sampling its columns (0 by default). Use this if
+     * long traces or large matrices need time to settle. Each row is driven while the previous row's sample
+     * is debounced and reported so only the part of the settle time not covered by that work is spent
+     * waiting.
      */
-    SwitchMatrixScanner(const uint8_t (&row_pins)[ROW_COUNT],
-                        const uint8_t (&column_pins)[COL_COUNT],
-                        const bool enable_pullups           = true,
-                        const bool enable_software_debounce = true)
-        : m_switch_map()
-        , m_row_pins()
-        , m_col_pins()
-        , m_switchhandler_closed(nullptr)
-        , m_switchhandler_open(nullptr)
-        , m_column_input_type((enable_pullups) ? INPUT_PULLUP : INPUT)
-        , m_enable_software_debounce(enable_software_debounce)
-        , m_scancode_event_buffer_opened{0}
-        , m_scancode_event_buffer_opened_len(0)
-        , m_scancode_event_buffer_closed{0}
-        , m_scancode_event_buffer_closed_len(0)
-        , m_switchhandler_userdata(nullptr)
+    void setRowSettleTime(const uint16_t microseconds)
     {
-        ScanCodeGenerator<row_count, col_count, SwitchDef>::updateScanItems(m_switch_map);
-        memcpy(m_row_pins, row_pins, sizeof(row_pins));
-        memcpy(m_col_pins, column_pins, sizeof(column_pins));
+        m_row_settle_us = microseconds;
     }
 
-    ~SwitchMatrixScanner() {}
-    SwitchMatrixScanner(const SwitchMatrixScanner&)  = delete;
-    SwitchMatrixScanner(const SwitchMatrixScanner&&) = delete;
-    SwitchMatrixScanner& operator=(const SwitchMatrixScanner&) = delete;
-    SwitchMatrixScanner& operator=(const SwitchMatrixScanner&&) = delete;
-
     /**
-     * Call from within the Arduino setup function. If handlers are provided they will be invoked
-     * from within the scan method. If omitted the sketch must use the isSwitchClosed method to determine
-     * switch state.
+     * Statistics recorded by the STATS policy since setup or the last resetStats. All zeros with the default
+     * NoScanStats policy.
      */
-    void setup(SwitchHandler switchclosed_handler = nullptr, SwitchHandler switchopen_handler = nullptr, void* userdata = nullptr)
+    ScanStats getStats() const
     {
-        m_switchhandler_closed = switchclosed_handler;
-        m_switchhandler_open   = switchopen_handler;
+        return m_stats.get();
+    }
 
-        for (size_t r = 0; r < ROW_COUNT; ++r)
-        {
-            pinMode(m_row_pins[r], INPUT);
-        }
-        for (size_t c = 0; c < COL_COUNT; ++c)
-        {
-            pinMode(m_col_pins[c], m_column_input_type);
-        }
-        m_switchhandler_userdata = userdata;
+    void resetStats()
+    {
+        m_stats.reset();
     }
 
     /**
-     * Call from within the Arduino loop method. When debouncing is enabled it is important to call
-     * this in a fast loop and at a regular period. Variable timing will cause weird delays to users
-     * of a keyboard where some keystrokes will be missed or will occur late.
-     * 
-     * @return true if anything changed else false.
+     * The STATS policy itself, for policies that record more than ScanStats (see SwitchTelemetryStats).
      */
-    bool scan()
+    const STATS& getStatsPolicy() const
     {
-        bool found_changes = false;
-        for (size_t r = 0; r < ROW_COUNT; ++r)
-        {
-            const uint8_t rowpin = m_row_pins[r];
-            pinMode(rowpin, OUTPUT);
-            digitalWrite(rowpin, LOW);
-            for (size_t c = 0; c < COL_COUNT; ++c)
-            {
-                SwitchDef& swtch = m_switch_map[r][c];
-                // Always sample to ensure the timing is stable despite hysteresis settings.
-                const int  value             = digitalRead(m_col_pins[c]);
-                const bool is_switch_pressed = (value == LOW);
-                if (m_enable_software_debounce)
-                {
-                    handleSoftwareDebounce(swtch, is_switch_pressed);
-                }
-                else
-                {
-                    static_assert(sizeof(swtch.sample_buffer) == 1,
-                                  "Hardcoded logic expects 1-byte sample_buffer. Modify this line if you changed the "
-                                  "sample_buffer type.");
-                    swtch.sample_buffer = (is_switch_pressed) ? 0xFF : 0x00;
-                }
-                if (handleSwitchState(swtch))
-                {
-                    found_changes = true;
-                    if (m_scancode_event_buffer_closed_len == EVENT_BUFFER_SIZE)
-                    {
-                        // We're about to overrun our event buffer so we'll have to flush
-                        // before we're done scanning.
-                        flush_closed_events();
-                    }
-                    if (m_scancode_event_buffer_opened_len == EVENT_BUFFER_SIZE)
-                    {
-                        // We're about to overrun our event buffer so we'll have to flush
-                        // before we're done scanning.
-                        flush_opened_events();
-                    }
-                }
-            }
-            // High-impedance
-            pinMode(rowpin, INPUT);
-        }
-        flush_closed_events();
-        flush_opened_events();
-        return found_changes;
+        return m_stats;
     }
 
     /**
@@ -267,6 +3075,8 @@ public:
      *     +-----------+
      *     | 7 | 8 | 9 |
      *     +-----------+
+     *
+     * See scancodeOf and ScanCodeMap.
      */
     bool isSwitchClosed(ScanCodeType scancode)
     {
@@ -281,34 +3091,144 @@ public:
         }
         const ScanCodeType row = scanindex / COL_COUNT;
         const ScanCodeType col = scanindex - (row * COL_COUNT);
-        return (m_switch_map[row][col].state == SwitchState::CLOSED);
+        return ((m_rows[row].closed & column_bit<RowMask>(col)) != 0);
     }
 
-private:
-    // +----------------------------------------------------------------------+
-    // | SOFTWARE DEBOUNCING PARAMETERS :: ADJUSTABLE
-    // +----------------------------------------------------------------------+
+    /**
+     * The scancode of the switch at the given row and column. Usable in constant expressions so keymaps and
+     * ScanCodeMap tables can be written in terms of matrix positions.
+     */
+    static constexpr ScanCodeType scancodeOf(const size_t row, const size_t column)
+    {
+        return static_cast<ScanCodeType>(row * COL_COUNT + column + 1);
+    }
 
-    static constexpr const uint8_t DebounceSettleCount = 1;
-    static constexpr const uint8_t DebounceSampleCount = 2;
-    static constexpr const uint8_t DebounceSettleBits  = 3;
-    static constexpr const uint8_t DebounceSampleBits  = 5;
+    /**
+     * Copies the state of every switch out in one call. Bit c of closed[r] is set if the switch at row r,
+     * column c is CLOSED.
+     */
+    void getClosedBitmap(RowMask (&closed)[ROW_COUNT]) const
+    {
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            closed[r] = m_rows[r].closed;
+        }
+    }
 
-    // +----------------------------------------------------------------------+
-    // | SOFTWARE DEBOUNCING PARAMETERS :: VALIDATION
-    // +----------------------------------------------------------------------+
-    static_assert(DebounceSettleCount <= (1 << DebounceSettleBits) - 1,
-                  "DebounceSettleCount must fit in DebounceSettleBits bits.");
-    static_assert(DebounceSampleCount <= DebounceSampleBits, "DebounceSampleCount must be <= DebounceSampleBits");
-    static_assert(DebounceSettleBits + DebounceSampleBits <= 8, "DebounceSampleBits + DebounceSettleBits must be <=8");
+    /**
+     * Walks the scancodes of the CLOSED switches in scancode order. The cost is proportional to the number of
+     * closed switches plus one word test per row.
+     */
+    class ClosedSwitchIterator
+    {
+    public:
+        ScanCodeType operator*() const
+        {
+            return scancodeOf(m_row, lowest_column(m_pending));
+        }
+
+        ClosedSwitchIterator& operator++()
+        {
+            m_pending = clear_lowest_column(m_pending);
+            skip_open_rows();
+            return *this;
+        }
+
+        bool operator==(const ClosedSwitchIterator& rhs) const
+        {
+            return (m_row == rhs.m_row && m_pending == rhs.m_pending);
+        }
+
+        bool operator!=(const ClosedSwitchIterator& rhs) const
+        {
+            return !(*this == rhs);
+        }
+
+    private:
+        friend class SwitchMatrixScanner;
+
+        ClosedSwitchIterator(const SwitchMatrixScanner& scanner, const size_t row)
+            : m_scanner(scanner)
+            , m_row(row)
+            , m_pending((row < ROW_COUNT) ? scanner.m_rows[row].closed : 0)
+        {
+            skip_open_rows();
+        }
+
+        void skip_open_rows()
+        {
+            while (m_pending == 0 && m_row < ROW_COUNT)
+            {
+                ++m_row;
+                m_pending = (m_row < ROW_COUNT) ? m_scanner.m_rows[m_row].closed : 0;
+            }
+        }
+
+        const SwitchMatrixScanner& m_scanner;
+        size_t                     m_row;
+        RowMask                    m_pending;
+    };
+
+    /**
+     * Use with a range-based for loop:
+     *
+     *      for (const gh::thirtytwobits::ScanCodeType scancode : scanner.closedSwitches())
+     *      {
+     *          ...
+     *      }
+     *
+     * The iterators are invalidated by the next scan.
+     */
+    class ClosedSwitches
+    {
+    public:
+        ClosedSwitchIterator begin() const
+        {
+            return ClosedSwitchIterator(m_scanner, 0);
+        }
+
+        ClosedSwitchIterator end() const
+        {
+            return ClosedSwitchIterator(m_scanner, ROW_COUNT);
+        }
+
+    private:
+        friend class SwitchMatrixScanner;
+
+        explicit ClosedSwitches(const SwitchMatrixScanner& scanner)
+            : m_scanner(scanner)
+        {}
+
+        const SwitchMatrixScanner& m_scanner;
+    };
 
+    ClosedSwitches closedSwitches() const
+    {
+        return ClosedSwitches(*this);
+    }
+
+private:
     // +----------------------------------------------------------------------+
-    // | SOFTWARE DEBOUNCING PARAMETERS :: COMPUTED
+    // | SOFTWARE DEBOUNCING :: STATE
     // +----------------------------------------------------------------------+
-    static constexpr const uint8_t DebounceSettleShift = DebounceSampleBits;
-    static constexpr const uint8_t DebounceSettleMask  = ((1 << DebounceSettleBits) - 1) << DebounceSettleShift;
-    static constexpr const uint8_t DebounceSampleMask  = ((1 << DebounceSampleCount) - 1);
-    // No sample shift since we always located it in the LSbs.
+    using DebounceRow = typename DEBOUNCE::template Row<COL_COUNT, RowMask>;
+
+    struct RowState
+    {
+        // The debounce policy's state for this row.
+        DebounceRow debounce;
+        // The debounced state. 1 = CLOSED, 0 = OPEN (or UNKNOWN if the known bit is 0).
+        RowMask closed;
+        // 0 until the switch's state has been determined for the first time.
+        RowMask known;
+        // The latest raw sample. Used by the anti-ghost check and the STATS policy.
+        RowMask sample;
+        // True while the debounce policy has work left for this row or any of its switches is UNKNOWN. A
+        // row that isn't in flight and whose sample matches its closed bitmap can't change.
+        bool in_flight;
+    };
+
+    static constexpr const RowMask ColumnMask = column_mask<RowMask>(COL_COUNT);
 
     // +----------------------------------------------------------------------+
     // | VALIDATE TEMPLATE PARAMS
@@ -320,114 +3240,455 @@ private:
     static_assert(COL_COUNT > 0, "COL_COUNT cannot be 0");
     static_assert(EVENT_BUFFER_SIZE > 0, "EVENT_BUFFER_SIZE cannot be 0");
 
+    // +----------------------------------------------------------------------+
+    // | EVENT SINKS
+    // +----------------------------------------------------------------------+
+    using HandlerQueue  = SwitchHandlerQueue<EVENT_BUFFER_SIZE, STATS>;
+    using SetupHandlers = typename HandlerQueue::SetupHandlers;
+    using NoHandler     = typename HandlerQueue::NoHandler;
+    using DiscardSink   = SwitchEventDiscardSink;
+    using BufferSink    = SwitchEventBufferSink;
+
+    template <typename CLOSED_HANDLER, typename OPEN_HANDLER>
+    using CallableHandlers = typename HandlerQueue::template CallableHandlers<CLOSED_HANDLER, OPEN_HANDLER>;
+
+    template <typename HANDLERS>
+    using CallbackSink = typename HandlerQueue::template Sink<HANDLERS>;
+
+    template <size_t RING_CAPACITY>
+    using RingSink = SwitchEventRingSink<RING_CAPACITY>;
+
+    /*
+     * Scans up to max_rows rows (which must not be 0) from m_cursor to the end of the frame.
+     */
+    template <typename Sink>
+    bool scanMatrix(Sink& sink, const size_t max_rows)
+    {
+        if (m_skip_countdown > 0 && !m_wake_requested)
+        {
+            // Decimated by the adaptive scan rate. This is only ever set at the start of a frame.
+            --m_skip_countdown;
+            count_quiet_frame();
+            m_stats.scanSkipped();
+            return false;
+        }
+        m_stats.scanBegin();
+        if (m_idle)
+        {
+            // Every row is driven LOW so any closed switch pulls its column down.
+            if (!m_wake_requested && m_pins.readColumns() == 0)
+            {
+                updateScanRate(true);
+                m_stats.scanEnd();
+                return false;
+            }
+            exitIdle();
+        }
+        const size_t first         = m_cursor;
+        const size_t end           = (max_rows < ROW_COUNT - first) ? first + max_rows : ROW_COUNT;
+        bool         found_changes = false;
+        uint32_t     selected_at   = m_preselected_at;
+        if (!m_row_preselected)
+        {
+            m_pins.selectRow(first);
+            selected_at = row_selected_at();
+        }
+        m_row_preselected = false;
+        for (size_t r = first; r < end; ++r)
+        {
+            waitForRowSettle(selected_at);
+            // Always sample every column to ensure the timing is stable despite hysteresis settings.
+            const RowMask sample = m_pins.readColumns();
+            if (r + 1 < end)
+            {
+                // Drive the next row now so it settles while this row's sample is processed.
+                advance_row(m_pins, r, r + 1);
+                selected_at = row_selected_at();
+            }
+            else
+            {
+                m_pins.releaseRow(r);
+            }
+            RowState&     row      = m_rows[r];
+            const RowMask previous = row.sample;
+            row.sample             = sample;
+            if (sample == row.closed && !row.in_flight)
+            {
+                // Nothing changed and nothing is being debounced in this row. This is the common case.
+                continue;
+            }
+            RowMask closed_events;
+            RowMask opened_events;
+            if (DEBOUNCE::enabled && m_enable_software_debounce)
+            {
+                const uint32_t now = DEBOUNCE::now();
+                RowMask        closed_samples;
+                RowMask        open_samples;
+                row.debounce.update(sample, now, closed_samples, open_samples);
+                if (m_enable_anti_ghost)
+                {
+                    closed_samples = static_cast<RowMask>(closed_samples & ~ambiguous_presses(row, closed_samples));
+                }
+                const RowMask changed =
+                    handleSwitchState(row, closed_samples, open_samples, sink.room(), closed_events, opened_events);
+                row.debounce.restart(changed, now);
+                row.in_flight = is_in_flight(row);
+            }
+            else
+            {
+                const RowMask closed_samples =
+                    m_enable_anti_ghost ? static_cast<RowMask>(sample & ~ambiguous_presses(row, sample)) : sample;
+                handleSwitchState(row,
+                                  closed_samples,
+                                  static_cast<RowMask>(ColumnMask & ~sample),
+                                  sink.room(),
+                                  closed_events,
+                                  opened_events);
+                row.in_flight = (row.known != ColumnMask);
+            }
+            const RowMask reported = static_cast<RowMask>(closed_events | opened_events);
+            m_stats.rowUpdated(r, sample, previous, row.closed, reported, row.in_flight);
+            if (reported != 0)
+            {
+                found_changes = true;
+                pushEvents(sink, r, closed_events, opened_events);
+            }
+        }
+        m_cursor              = (end == ROW_COUNT) ? 0 : end;
+        const bool frame_done = (m_cursor == 0);
+        if (!frame_done && m_slice_lookahead)
+        {
+            // The next slice's first row settles while the caller does something else.
+            m_pins.selectRow(m_cursor);
+            m_preselected_at  = row_selected_at();
+            m_row_preselected = true;
+        }
+        if (frame_done || m_slice_event_delivery == SliceEventDelivery::PER_SLICE)
+        {
+            sink.finish();
+        }
+        if (frame_done && (m_enable_idle_mode || m_rate_steps != nullptr))
+        {
+            const bool quiet = is_quiescent();
+            if (quiet && m_enable_idle_mode)
+            {
+                enterIdle();
+            }
+            updateScanRate(quiet);
+        }
+        m_stats.scanEnd();
+        return found_changes;
+    }
+
     // +----------------------------------------------------------------------+
     // | HELPERS
     // +----------------------------------------------------------------------+
-    void flush_opened_events()
+    uint32_t row_selected_at() const
     {
-        if (m_scancode_event_buffer_opened_len > 0)
+        return (m_row_settle_us > 0) ? static_cast<uint32_t>(micros()) : 0;
+    }
+
+    /*
+     * Busy-waits for whatever is left of the row settle time. Usually the previous row's processing has
+     * already used it up.
+     */
+    void waitForRowSettle(const uint32_t selected_at) const
+    {
+        if (m_row_settle_us > 0)
         {
-            onSwitchOpen(m_scancode_event_buffer_opened, m_scancode_event_buffer_opened_len);
-            m_scancode_event_buffer_opened_len = 0;
+            while (static_cast<uint32_t>(micros()) - selected_at < m_row_settle_us)
+            {
+            }
         }
     }
 
-    void flush_closed_events()
+    bool is_quiescent() const
     {
-        if (m_scancode_event_buffer_closed_len > 0)
+        for (size_t r = 0; r < ROW_COUNT; ++r)
         {
-            onSwitchClosed(m_scancode_event_buffer_closed, m_scancode_event_buffer_closed_len);
-            m_scancode_event_buffer_closed_len = 0;
+            if (m_rows[r].closed != 0 || m_rows[r].in_flight)
+            {
+                return false;
+            }
         }
+        return true;
     }
 
-    static constexpr bool is_closed(const uint8_t sample_mask, const uint8_t sample_buffer)
+    void count_quiet_frame()
     {
-        return (sample_mask & sample_buffer) == sample_mask;
+        if (m_quiet_frames < 0xFFFF)
+        {
+            ++m_quiet_frames;
+        }
     }
 
-    static constexpr bool is_open(const uint8_t sample_mask, const uint8_t sample_buffer)
+    /*
+     * Called at the end of each frame. Picks the divider for the quiet frame count and starts skipping.
+     */
+    void updateScanRate(const bool quiet)
     {
-        return (sample_mask & sample_buffer) == 0;
+        if (m_rate_steps == nullptr)
+        {
+            return;
+        }
+        if (!quiet)
+        {
+            m_quiet_frames = 0;
+            m_scan_divider = 1;
+            return;
+        }
+        count_quiet_frame();
+        uint8_t divider = 1;
+        for (uint8_t i = 0; i < m_rate_steps_len && m_quiet_frames >= m_rate_steps[i].quiet_frames; ++i)
+        {
+            divider = m_rate_steps[i].divider;
+        }
+        m_scan_divider   = (divider > 0) ? divider : 1;
+        m_skip_countdown = static_cast<uint8_t>(m_scan_divider - 1);
     }
 
-    static constexpr uint8_t reset_sample_count(const SwitchDef& swtch)
+    // +----------------------------------------------------------------------+
+    // | IDLE MODE :: WAKE INTERRUPTS
+    // +----------------------------------------------------------------------+
+    /*
+     * attachInterrupt takes a plain function so each idle scanner of this type gets a slot in s_wake_instances
+     * and the handler for that slot sets the wake flag of whichever scanner holds it.
+     */
+    template <size_t SLOT>
+    static void onWakeInterrupt()
     {
-        return (DebounceSampleMask & swtch.sample_buffer);
+        SwitchMatrixScanner* const scanner = s_wake_instances[SLOT];
+        if (scanner != nullptr)
+        {
+            scanner->m_wake_requested = true;
+        }
     }
 
-    void handleSoftwareDebounce(SwitchDef& swtch, bool is_switch_pressed)
+    static_assert(max_wake_instances == 4, "wake_interrupt_for needs a handler for every slot.");
+
+    static void (*wake_interrupt_for(const size_t slot))()
     {
-        const uint8_t settle_count = (swtch.sample_buffer & DebounceSettleMask) >> DebounceSettleShift;
-        if (settle_count < DebounceSettleCount)
+        switch (slot)
         {
-            // We're still in the settle window. Increment the settle count.
-            swtch.sample_buffer =
-                ((settle_count + 1) << DebounceSettleShift) | (DebounceSampleMask & swtch.sample_buffer);
+        case 0:
+            return onWakeInterrupt<0>;
+        case 1:
+            return onWakeInterrupt<1>;
+        case 2:
+            return onWakeInterrupt<2>;
+        default:
+            return onWakeInterrupt<3>;
         }
-        else
+    }
+
+    /*
+     * The handler for a free slot, now held by this scanner, or nullptr if every slot is taken.
+     */
+    void (*claimWakeSlot())()
+    {
+        for (size_t slot = 0; slot < max_wake_instances; ++slot)
+        {
+            if (s_wake_instances[slot] == nullptr || s_wake_instances[slot] == this)
+            {
+                s_wake_instances[slot] = this;
+                return wake_interrupt_for(slot);
+            }
+        }
+        return nullptr;
+    }
+
+    void releaseWakeSlot()
+    {
+        for (size_t slot = 0; slot < max_wake_instances; ++slot)
+        {
+            if (s_wake_instances[slot] == this)
+            {
+                s_wake_instances[slot] = nullptr;
+            }
+        }
+    }
+
+    void enterIdle()
+    {
+        m_wake_requested = false;
+        m_pins.selectAllRows();
+        const uint32_t selected_at = row_selected_at();
+        void (*const isr)()        = claimWakeSlot();
+        m_wake_armed               = (isr != nullptr) && m_pins.armWake(isr);
+        m_idle                     = true;
+        // A switch that closed after its row was scanned, or before the interrupts were attached, already
+        // holds its column LOW and won't give a falling edge. Don't let the sketch sleep through it.
+        waitForRowSettle(selected_at);
+        if (m_pins.readColumns() != 0)
         {
-            swtch.sample_buffer = (settle_count << DebounceSettleShift) |
-                                  (DebounceSampleMask & (swtch.sample_buffer << 1)) | ((is_switch_pressed) ? 1 : 0);
+            m_wake_requested = true;
         }
     }
 
-    bool handleSwitchState(SwitchDef& swtch)
+    void exitIdle()
+    {
+        m_pins.disarmWake();
+        releaseWakeSlot();
+        m_pins.releaseAllRows();
+        m_idle = false;
+    }
+
+    /*
+     * New presses in row whose columns overlap another row in two or more places. Without diodes any one of
+     * the four corners of such a rectangle could be a phantom so none of the new presses can be trusted. The
+     * other rows are compared using both their committed state and their latest sample so switches
+     * pressed at the same time block each other.
+     */
+    RowMask ambiguous_presses(const RowState& row, const RowMask closed_samples) const
     {
-        bool pending_event = false;
-        if (is_closed(DebounceSampleMask, swtch.sample_buffer) && swtch.state != SwitchState::CLOSED)
+        const RowMask pressing = static_cast<RowMask>(closed_samples & ~row.closed);
+        if (pressing == 0)
         {
-            swtch.state                                                          = SwitchState::CLOSED;
-            m_scancode_event_buffer_closed[m_scancode_event_buffer_closed_len++] = swtch.scancode;
-            swtch.sample_buffer                                                  = reset_sample_count(swtch);
-            pending_event                                                        = true;
+            return 0;
         }
-        else if (is_open(DebounceSampleMask, swtch.sample_buffer) && swtch.state != SwitchState::OPEN)
+        const RowMask candidate = static_cast<RowMask>(closed_samples | row.closed);
+        RowMask       ambiguous = 0;
+        for (size_t o = 0; o < ROW_COUNT; ++o)
         {
-            const SwitchState oldState = swtch.state;
-            swtch.state                = SwitchState::OPEN;
-            if (oldState != SwitchState::UNKNOWN)
+            const RowState& other = m_rows[o];
+            if (&other == &row)
+            {
+                continue;
+            }
+            const RowMask overlap = static_cast<RowMask>(candidate & (other.closed | other.sample));
+            if (clear_lowest_column(overlap) != 0)
             {
-                m_scancode_event_buffer_opened[m_scancode_event_buffer_opened_len++] = swtch.scancode;
-                pending_event                                                        = true;
-            } // else we ignore the first onKeyUp events.
-            swtch.sample_buffer = reset_sample_count(swtch);
+                // Two or more bits set.
+                ambiguous = static_cast<RowMask>(ambiguous | overlap);
+            }
         }
-        return pending_event;
+        return static_cast<RowMask>(ambiguous & pressing);
+    }
+
+    static bool is_in_flight(const RowState& row)
+    {
+        return (row.known != ColumnMask) || row.debounce.inFlight(row.closed);
     }
 
-    void onSwitchClosed(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], size_t scancodes_len)
+    /*
+     * Commits state changes for switches whose samples agree and reports which switches closed and
+     * which opened. The first transition out of UNKNOWN into OPEN is not reported.
+     *
+     * @return Every switch whose state was committed, including those leaving UNKNOWN.
+     */
+    static RowMask handleSwitchState(RowState&     row,
+                                     const RowMask closed_samples,
+                                     const RowMask open_samples,
+                                     const size_t  room,
+                                     RowMask&      out_closed,
+                                     RowMask&      out_opened)
     {
-        const SwitchHandler switchhandler_closed = m_switchhandler_closed;
-        if (switchhandler_closed != nullptr)
+        RowMask now_closed = static_cast<RowMask>(closed_samples & ~row.closed);
+        RowMask now_open   = static_cast<RowMask>(open_samples & (row.closed | ~row.known));
+        if (room < COL_COUNT)
         {
-            switchhandler_closed(scancodes, scancodes_len, m_switchhandler_userdata);
+            // Defer whatever the sink can't take by leaving those switches uncommitted.
+            const RowMask reported = static_cast<RowMask>(now_closed | (now_open & row.known));
+            const RowMask deferred = static_cast<RowMask>(reported & ~lowest_columns(reported, room));
+            now_closed             = static_cast<RowMask>(now_closed & ~deferred);
+            now_open   = static_cast<RowMask>(now_open & ~deferred);
         }
+        const RowMask changed = static_cast<RowMask>(now_closed | now_open);
+        out_closed               = now_closed;
+        out_opened               = static_cast<RowMask>(now_open & row.known);
+        row.closed               = static_cast<RowMask>((row.closed | now_closed) & ~now_open);
+        row.known |= changed;
+        return changed;
     }
 
-    void onSwitchOpen(const ScanCodeType (&scancodes)[EVENT_BUFFER_SIZE], size_t scancodes_len)
+    /*
+     * The set bits with the n lowest column indices.
+     */
+    static RowMask lowest_columns(RowMask mask, size_t n)
     {
-        const SwitchHandler switchhandler_open = m_switchhandler_open;
-        if (switchhandler_open != nullptr)
+        RowMask lowest = 0;
+        while (n > 0 && mask != 0)
         {
-            switchhandler_open(scancodes, scancodes_len, m_switchhandler_userdata);
+            const RowMask bit = column_bit<RowMask>(lowest_column(mask));
+            lowest            = static_cast<RowMask>(lowest | bit);
+            mask              = static_cast<RowMask>(mask & ~bit);
+            --n;
         }
+        return lowest;
     }
 
-    SwitchDef     m_switch_map[ROW_COUNT][COL_COUNT];
-    uint8_t       m_row_pins[ROW_COUNT];
-    uint8_t       m_col_pins[COL_COUNT];
-    SwitchHandler m_switchhandler_closed;
-    SwitchHandler m_switchhandler_open;
-    const uint8_t m_column_input_type;
-    const bool    m_enable_software_debounce;
-    ScanCodeType  m_scancode_event_buffer_opened[EVENT_BUFFER_SIZE];
-    size_t        m_scancode_event_buffer_opened_len;
-    ScanCodeType  m_scancode_event_buffer_closed[EVENT_BUFFER_SIZE];
-    size_t        m_scancode_event_buffer_closed_len;
-    void*         m_switchhandler_userdata;
+    /*
+     * Translates the switches that changed in a row into scancodes in column order. Scancodes aren't stored;
+     * the scancode of row r, column c is always r * COL_COUNT + c + 1.
+     */
+    template <typename Sink>
+    static void pushEvents(Sink& sink, const size_t row, const RowMask closed, const RowMask opened)
+    {
+        const ScanCodeType row_scancode = scancodeOf(row, 0);
+        RowMask            pending      = static_cast<RowMask>(closed | opened);
+        while (pending != 0)
+        {
+            const uint8_t c   = lowest_column(pending);
+            const RowMask bit = column_bit<RowMask>(c);
+            pending           = static_cast<RowMask>(pending & ~bit);
+            sink.push(static_cast<ScanCodeType>(row_scancode + c),
+                      ((closed & bit) != 0) ? SwitchEdge::CLOSED : SwitchEdge::OPENED);
+        }
+    }
+
+    using PinDriver = typename PIN_ACCESS::template Driver<ROW_COUNT, COL_COUNT, RowMask>;
+
+    RowState            m_rows[ROW_COUNT];
+    PinDriver           m_pins;
+    const uint8_t       m_column_input_type;
+    const bool          m_enable_software_debounce;
+    const ScanRateStep* m_rate_steps;
+    // When the row at m_cursor was driven by the previous slice. See setSliceLookahead.
+    uint32_t            m_preselected_at;
+    uint16_t            m_row_settle_us;
+    // The next row scanRows will scan.
+    size_t              m_cursor;
+    SliceEventDelivery  m_slice_event_delivery;
+    bool                m_enable_anti_ghost;
+    bool                m_enable_idle_mode;
+    bool                m_idle;
+    bool                m_wake_armed;
+    // Set by this scanner's wake interrupt while idle.
+    volatile bool       m_wake_requested;
+    bool                m_slice_lookahead;
+    bool                m_row_preselected;
+    uint8_t             m_rate_steps_len;
+    uint8_t             m_scan_divider;
+    // Calls left to skip before the next scan.
+    uint8_t             m_skip_countdown;
+    uint16_t            m_quiet_frames;
+    // Kept after the bools so the empty NoScanStats usually fits in their padding.
+    STATS               m_stats;
+    HandlerQueue        m_handler_queue;
+
+    // The scanners of this type that are idle, indexed by the wake interrupt handler they armed.
+    static SwitchMatrixScanner* volatile s_wake_instances[max_wake_instances];
 };
 
+template <size_t ROW_COUNT,
+          size_t COL_COUNT,
+          size_t EVENT_BUFFER_SIZE,
+          typename PIN_ACCESS,
+          typename DEBOUNCE,
+          typename STATS>
+SwitchMatrixScanner<ROW_COUNT, COL_COUNT, EVENT_BUFFER_SIZE, PIN_ACCESS, DEBOUNCE, STATS>* volatile
+    SwitchMatrixScanner<ROW_COUNT, COL_COUNT, EVENT_BUFFER_SIZE, PIN_ACCESS, DEBOUNCE, STATS>::s_wake_instances
+        [max_wake_instances] = {};
+
+template <size_t ROW_COUNT,
+          size_t COL_COUNT,
+          size_t EVENT_BUFFER_SIZE,
+          typename PIN_ACCESS,
+          typename DEBOUNCE,
+          typename STATS>
+constexpr const typename SwitchMatrixScanner<ROW_COUNT, COL_COUNT, EVENT_BUFFER_SIZE, PIN_ACCESS, DEBOUNCE, STATS>::RowMask
+    SwitchMatrixScanner<ROW_COUNT, COL_COUNT, EVENT_BUFFER_SIZE, PIN_ACCESS, DEBOUNCE, STATS>::ColumnMask;
+
 };  // namespace thirtytwobits
 };  // namespace gh
 
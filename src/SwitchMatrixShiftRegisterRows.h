@@ -0,0 +1,148 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_SHIFT_REGISTER_ROWS_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_SHIFT_REGISTER_ROWS_H
+
+#include <SPI.h>
+#include "SwitchMatrixScanner.h"
+
+namespace gh
+{
+namespace thirtytwobits
+{
+/**
+ * Drives rows through a chain of 74HC595 shift registers over SPI. Use it as the ROWS half of SplitPins.
+ * The row "pins" are output numbers on the chain: 0 to 7 are QA to QH of the register connected to the MCU,
+ * 8 to 15 are the next register and so on up to 8 * REGISTER_COUNT - 1. Rows given an output past the end of
+ * the chain are never driven.
+ *
+ * The selected row is driven LOW and every other row is driven HIGH, since a 595 has no high-impedance
+ * state per output, so the matrix needs a diode on every switch. Every row change, including moving from one
+ * row to the next during a scan, is one SPI transaction of the whole chain.
+ *
+ * Call SPI.begin() before SwitchMatrixScanner::setup.
+ *
+ * Example:
+ *
+ *      #include <SwitchMatrixScanner.h>
+ *      #include <SwitchMatrixShiftRegisterRows.h>
+ *
+ *      using Pins = gh::thirtytwobits::SplitPins<gh::thirtytwobits::ShiftRegisterRows<10, 2>,
+ *                                                gh::thirtytwobits::ArduinoColumns>;
+ *
+ *      const byte rowOutputs[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+ *      gh::thirtytwobits::SwitchMatrixScanner<16, COLS, 10, Pins> scanner(rowOutputs, colPins);
+ *
+ * @tparam LATCH_PIN       The Arduino pin connected to the 595 storage register clock (RCLK).
+ * @tparam REGISTER_COUNT  How many 595s are in the chain. Every row change shifts out all of them.
+ * @tparam SPI_CLOCK_HZ    SPI clock for the chain.
+ */
+template <uint8_t LATCH_PIN, size_t REGISTER_COUNT, uint32_t SPI_CLOCK_HZ = 8000000UL>
+struct ShiftRegisterRows
+{
+    static_assert(REGISTER_COUNT > 0, "The chain needs at least one register.");
+
+    template <size_t ROW_COUNT>
+    class Driver
+    {
+    public:
+        static_assert(ROW_COUNT <= 8 * REGISTER_COUNT, "The chain has fewer outputs than the matrix has rows.");
+
+        explicit Driver(const uint8_t (&row_pins)[ROW_COUNT])
+            : m_row_register()
+            , m_row_bit()
+            , m_outputs()
+        {
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                const uint8_t output = row_pins[r];
+                // The pins are only known at run time. A bit of 0 leaves a row past the end of the chain alone.
+                m_row_register[r] = (output < 8 * REGISTER_COUNT) ? static_cast<uint8_t>(output >> 3) : 0;
+                m_row_bit[r]      = (output < 8 * REGISTER_COUNT) ? static_cast<uint8_t>(1U << (output & 7)) : 0;
+            }
+        }
+
+        void setup()
+        {
+            pinMode(LATCH_PIN, OUTPUT);
+            digitalWrite(LATCH_PIN, HIGH);
+            releaseAllRows();
+        }
+
+        void selectRow(const size_t row)
+        {
+            m_outputs[m_row_register[row]] &= static_cast<uint8_t>(~m_row_bit[row]);
+            write();
+        }
+
+        void releaseRow(const size_t row)
+        {
+            m_outputs[m_row_register[row]] |= m_row_bit[row];
+            write();
+        }
+
+        void advanceRow(const size_t from, const size_t to)
+        {
+            m_outputs[m_row_register[from]] |= m_row_bit[from];
+            m_outputs[m_row_register[to]] &= static_cast<uint8_t>(~m_row_bit[to]);
+            write();
+        }
+
+        void selectAllRows()
+        {
+            memset(m_outputs, 0x00, sizeof(m_outputs));
+            write();
+        }
+
+        void releaseAllRows()
+        {
+            memset(m_outputs, 0xFF, sizeof(m_outputs));
+            write();
+        }
+
+    private:
+        void write()
+        {
+            SPI.beginTransaction(SPISettings(SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+            digitalWrite(LATCH_PIN, LOW);
+            // The first byte out ends up in the register furthest from the MCU.
+            for (size_t i = REGISTER_COUNT; i > 0; --i)
+            {
+                SPI.transfer(m_outputs[i - 1]);
+            }
+            digitalWrite(LATCH_PIN, HIGH);
+            SPI.endTransaction();
+        }
+
+        uint8_t m_row_register[ROW_COUNT];
+        uint8_t m_row_bit[ROW_COUNT];
+        uint8_t m_outputs[REGISTER_COUNT];
+    };
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_SHIFT_REGISTER_ROWS_H
@@ -0,0 +1,392 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_SPLIT_LINK_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_SPLIT_LINK_H
+
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Links the two halves of a split keyboard over a serial port. The secondary half sends the rows that changed
+ * after each scan and the primary half turns them into SwitchEvents in its own scancode space.
+ *
+ * Each frame is:
+ *
+ *      +------+-------+-----------+------------------+-----+----------+
+ *      | 0xD5 | count | row index | row mask (LE)    | ... | checksum |
+ *      +------+-------+-----------+------------------+-----+----------+
+ *                     |<-- count times, changed rows only -->|
+ *
+ * where the row mask is the row's complete closed state (one bit per column) and the checksum is the 8-bit
+ * sum of every byte after the sync byte. Sending whole rows instead of single switch changes means a lost frame
+ * is corrected by the next change to the same row. So that a lost frame can't leave a switch stuck until then,
+ * the sender also sends every row once per refresh interval (100 ms by default) even if nothing changed. These
+ * frames double as a keepalive: if the receiver gets no valid frame for its timeout (300 ms by default) it
+ * reports every remote switch as open until the link comes back.
+ *
+ * Secondary:
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS> scanner(rowPins, colPins);
+ *      gh::thirtytwobits::SplitLinkSender<ROWS, COLS>     link;
+ *
+ *      void setup()
+ *      {
+ *          Serial1.begin(1000000);
+ *          scanner.setup();
+ *      }
+ *
+ *      void loop()
+ *      {
+ *          scanner.scan();
+ *          link.update(scanner, Serial1);
+ *      }
+ *
+ * Primary (the remote switches follow the local ones):
+ *
+ *      gh::thirtytwobits::SwitchMatrixScanner<ROWS, COLS>                  scanner(rowPins, colPins);
+ *      gh::thirtytwobits::SplitLinkReceiver<ROWS, COLS, ROWS * COLS>       remote;
+ *
+ *      void loop()
+ *      {
+ *          gh::thirtytwobits::SwitchEvent events[16];
+ *          size_t events_len = scanner.scan(events, 16);
+ *          events_len += remote.poll(Serial1, events + events_len, 16 - events_len);
+ *          ...
+ *      }
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+namespace
+{
+constexpr uint8_t SplitLinkSync = 0xD5;
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | SplitLinkSender
+// +--------------------------------------------------------------------------+
+/**
+ * Runs on the secondary half. ROW_COUNT and COL_COUNT must match its scanner.
+ *
+ * @tparam CLOCK  Microsecond clock for the refresh interval. See TimedDebounce.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT, typename CLOCK = MicrosClock>
+class SplitLinkSender final
+{
+public:
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    static_assert(ROW_COUNT <= 255, "Row indices are sent as one byte.");
+
+    SplitLinkSender()
+        : m_sent()
+        , m_refresh_us(100000UL)
+        , m_refreshed_at(0)
+        , m_resync(true)
+    {}
+
+    SplitLinkSender(const SplitLinkSender&)  = delete;
+    SplitLinkSender(const SplitLinkSender&&) = delete;
+    SplitLinkSender& operator=(const SplitLinkSender&) = delete;
+    SplitLinkSender& operator=(const SplitLinkSender&&) = delete;
+
+    /**
+     * Call after every scan. Writes one frame holding the rows that changed since the last frame, if any, or
+     * every row once the refresh interval has passed. STREAM is anything with `write(const uint8_t*, size_t)`
+     * such as a HardwareSerial.
+     *
+     * @return true if a frame was written.
+     */
+    template <typename SCANNER, typename STREAM>
+    bool update(const SCANNER& scanner, STREAM& stream)
+    {
+        static_assert(SCANNER::row_count == ROW_COUNT && SCANNER::col_count == COL_COUNT,
+                      "The sender must match the scanner's dimensions.");
+        RowMask closed[ROW_COUNT];
+        scanner.getClosedBitmap(closed);
+        const uint32_t now = CLOCK::now();
+        if (m_refresh_us > 0 && now - m_refreshed_at >= m_refresh_us)
+        {
+            m_resync = true;
+        }
+        if (m_resync)
+        {
+            m_refreshed_at = now;
+        }
+        uint8_t frame[MaxFrameSize];
+        size_t  frame_len = 2;
+        uint8_t count     = 0;
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            if (closed[r] == m_sent[r] && !m_resync)
+            {
+                continue;
+            }
+            m_sent[r]          = closed[r];
+            frame[frame_len++] = static_cast<uint8_t>(r);
+            for (size_t b = 0; b < sizeof(RowMask); ++b)
+            {
+                frame[frame_len++] = row_mask_byte(closed[r], b);
+            }
+            ++count;
+        }
+        m_resync = false;
+        if (count == 0)
+        {
+            return false;
+        }
+        frame[0]    = SplitLinkSync;
+        frame[1]    = count;
+        uint8_t sum = 0;
+        for (size_t i = 1; i < frame_len; ++i)
+        {
+            sum = static_cast<uint8_t>(sum + frame[i]);
+        }
+        frame[frame_len++] = sum;
+        stream.write(frame, frame_len);
+        return true;
+    }
+
+    /**
+     * Sends every row with the next update, for example after the primary half restarts.
+     */
+    void resync()
+    {
+        m_resync = true;
+    }
+
+    /**
+     * How often every row is sent whether or not it changed. Keep it well under the receiver's timeout. 0 only
+     * sends changes, which leaves lost frames uncorrected and lets the receiver time out while nothing changes.
+     */
+    void setRefreshInterval(const uint32_t interval_us)
+    {
+        m_refresh_us = interval_us;
+    }
+
+private:
+    static constexpr const size_t MaxFrameSize = 3 + ROW_COUNT * (1 + sizeof(RowMask));
+
+    RowMask  m_sent[ROW_COUNT];
+    uint32_t m_refresh_us;
+    uint32_t m_refreshed_at;
+    bool     m_resync;
+};
+
+// +--------------------------------------------------------------------------+
+// | SplitLinkReceiver
+// +--------------------------------------------------------------------------+
+/**
+ * Runs on the primary half. ROW_COUNT and COL_COUNT are the secondary half's dimensions. The remote switch at
+ * row r, column c gets scancode SCANCODE_OFFSET + r * COL_COUNT + c + 1.
+ *
+ * @tparam CLOCK  Microsecond clock for the link timeout. See TimedDebounce.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT, ScanCodeType SCANCODE_OFFSET, typename CLOCK = MicrosClock>
+class SplitLinkReceiver final
+{
+public:
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    static_assert(ROW_COUNT <= 255, "Row indices are sent as one byte.");
+    static_assert(SCANCODE_OFFSET + ROW_COUNT * COL_COUNT < 0xFFFF, "Remote scancodes must fit in ScanCodeType.");
+
+    SplitLinkReceiver()
+        : m_latest()
+        , m_reported()
+        , m_frame()
+        , m_frame_len(0)
+        , m_bad_frames(0)
+        , m_timeout_us(300000UL)
+        , m_last_frame_at(0)
+        , m_link_up(false)
+    {}
+
+    SplitLinkReceiver(const SplitLinkReceiver&)  = delete;
+    SplitLinkReceiver(const SplitLinkReceiver&&) = delete;
+    SplitLinkReceiver& operator=(const SplitLinkReceiver&) = delete;
+    SplitLinkReceiver& operator=(const SplitLinkReceiver&&) = delete;
+
+    /**
+     * Reads whatever has arrived without blocking and writes the resulting events into the given buffer.
+     * STREAM is anything with `int available()` and `int read()` such as a HardwareSerial. Changes that
+     * don't fit are reported by a later call. If the link has timed out every remote switch is reported open.
+     *
+     * @return The number of events written.
+     */
+    template <typename STREAM>
+    size_t poll(STREAM& stream, SwitchEvent* const events, const size_t max_events)
+    {
+        const uint32_t now = CLOCK::now();
+        while (stream.available() > 0)
+        {
+            receive(static_cast<uint8_t>(stream.read()), now);
+        }
+        if (m_link_up && m_timeout_us > 0 && now - m_last_frame_at >= m_timeout_us)
+        {
+            // Whatever the secondary half last said can't be trusted any more.
+            m_link_up = false;
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                m_latest[r] = 0;
+            }
+        }
+        size_t events_len = 0;
+        for (size_t r = 0; r < ROW_COUNT && events_len < max_events; ++r)
+        {
+            RowMask pending = static_cast<RowMask>(m_latest[r] ^ m_reported[r]);
+            while (pending != 0 && events_len < max_events)
+            {
+                const uint8_t      c        = lowest_column(pending);
+                const RowMask      bit      = column_bit<RowMask>(c);
+                const ScanCodeType scancode = static_cast<ScanCodeType>(SCANCODE_OFFSET + r * COL_COUNT + c + 1);
+                const SwitchEdge   edge     = ((m_latest[r] & bit) != 0) ? SwitchEdge::CLOSED : SwitchEdge::OPENED;
+                pending                     = static_cast<RowMask>(pending & ~bit);
+                m_reported[r]               = static_cast<RowMask>(m_reported[r] ^ bit);
+                events[events_len++]        = SwitchEvent{scancode, edge};
+            }
+        }
+        return events_len;
+    }
+
+    /**
+     * The state of a remote switch as already reported by poll. Takes scancodes in the merged space.
+     */
+    bool isSwitchClosed(const ScanCodeType scancode) const
+    {
+        if (scancode <= SCANCODE_OFFSET || scancode > SCANCODE_OFFSET + ROW_COUNT * COL_COUNT)
+        {
+            return false;
+        }
+        const size_t scanindex = scancode - SCANCODE_OFFSET - 1;
+        const size_t row       = scanindex / COL_COUNT;
+        return ((m_reported[row] & column_bit<RowMask>(scanindex - row * COL_COUNT)) != 0);
+    }
+
+    /**
+     * Frames dropped because of a bad checksum or row index.
+     */
+    uint32_t getBadFrameCount() const
+    {
+        return m_bad_frames;
+    }
+
+    /**
+     * True from the first valid frame until no valid frame has arrived for the timeout.
+     */
+    bool isLinkUp() const
+    {
+        return m_link_up;
+    }
+
+    /**
+     * How long without a valid frame before every remote switch is released. It must be longer than the
+     * sender's refresh interval. 0 never times out.
+     */
+    void setTimeout(const uint32_t timeout_us)
+    {
+        m_timeout_us = timeout_us;
+    }
+
+private:
+    static constexpr const size_t RowRecordSize = 1 + sizeof(RowMask);
+    static constexpr const size_t MaxFrameSize  = 3 + ROW_COUNT * RowRecordSize;
+
+    void receive(const uint8_t byte, const uint32_t now)
+    {
+        if (m_frame_len == 0 && byte != SplitLinkSync)
+        {
+            // Not in a frame. Wait for the next sync byte.
+            return;
+        }
+        if (m_frame_len == 1 && (byte == 0 || byte > ROW_COUNT))
+        {
+            m_frame_len = 0;
+            ++m_bad_frames;
+            return;
+        }
+        m_frame[m_frame_len++] = byte;
+        if (m_frame_len < 2 || m_frame_len < 3 + m_frame[1] * RowRecordSize)
+        {
+            return;
+        }
+        m_frame_len = 0;
+        if (!applyFrame())
+        {
+            ++m_bad_frames;
+            return;
+        }
+        m_last_frame_at = now;
+        m_link_up       = true;
+    }
+
+    bool applyFrame()
+    {
+        const size_t records  = m_frame[1];
+        const size_t checksum = 2 + records * RowRecordSize;
+        uint8_t      sum      = 0;
+        for (size_t i = 1; i < checksum; ++i)
+        {
+            sum = static_cast<uint8_t>(sum + m_frame[i]);
+        }
+        if (sum != m_frame[checksum])
+        {
+            return false;
+        }
+        for (size_t i = 0; i < records; ++i)
+        {
+            if (m_frame[2 + i * RowRecordSize] >= ROW_COUNT)
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < records; ++i)
+        {
+            const uint8_t* const record = &m_frame[2 + i * RowRecordSize];
+            RowMask              mask   = 0;
+            for (size_t b = 0; b < sizeof(RowMask); ++b)
+            {
+                set_row_mask_byte(mask, b, record[1 + b]);
+            }
+            m_latest[record[0]] = static_cast<RowMask>(mask & column_mask<RowMask>(COL_COUNT));
+        }
+        return true;
+    }
+
+    // The latest state received and the state already reported as events.
+    RowMask  m_latest[ROW_COUNT];
+    RowMask  m_reported[ROW_COUNT];
+    uint8_t  m_frame[MaxFrameSize];
+    size_t   m_frame_len;
+    uint32_t m_bad_frames;
+    uint32_t m_timeout_us;
+    uint32_t m_last_frame_at;
+    bool     m_link_up;
+};
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_SPLIT_LINK_H
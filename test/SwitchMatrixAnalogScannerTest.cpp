@@ -0,0 +1,238 @@
+#include "gmock/gmock.h"
+
+#define INPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT 3
+#define LOW 4
+#define HIGH 5
+
+void digitalWrite(int pin, int level);
+
+int digitalRead(int pin);
+
+void pinMode(int pin, int mode);
+
+int analogRead(int pin);
+
+unsigned long micros();
+
+#include "SwitchMatrixAnalogScanner.h"
+
+using gh::thirtytwobits::SwitchEdge;
+using gh::thirtytwobits::SwitchEvent;
+
+namespace
+{
+/*
+ * Rows and ADC columns that read from a table instead of hardware.
+ */
+struct ScriptedAnalogRows
+{
+    static int selected_row;
+
+    template <size_t ROW_COUNT>
+    class Driver
+    {
+    public:
+        explicit Driver(const uint8_t (&)[ROW_COUNT]) {}
+
+        void setup() {}
+
+        void selectRow(size_t row)
+        {
+            EXPECT_EQ(selected_row, -1);
+            selected_row = static_cast<int>(row);
+        }
+
+        void releaseRow(size_t row)
+        {
+            EXPECT_EQ(selected_row, static_cast<int>(row));
+            selected_row = -1;
+        }
+    };
+};
+
+int ScriptedAnalogRows::selected_row = -1;
+
+struct ScriptedAnalogColumns
+{
+    static uint16_t values[2][2];
+
+    template <size_t COL_COUNT>
+    class Reader
+    {
+    public:
+        explicit Reader(const uint8_t (&)[COL_COUNT]) {}
+
+        void setup() {}
+
+        void startConversion()
+        {
+            m_row = ScriptedAnalogRows::selected_row;
+            EXPECT_NE(m_row, -1);
+        }
+
+        void readColumns(uint16_t (&out)[COL_COUNT])
+        {
+            // The conversions belong to the row selected when they were started.
+            memcpy(out, values[m_row], sizeof(out));
+        }
+
+    private:
+        int m_row = -1;
+    };
+};
+
+uint16_t ScriptedAnalogColumns::values[2][2] = {{0}};
+
+using Scanner = gh::thirtytwobits::AnalogSwitchMatrixScanner<2, 2, 4, ScriptedAnalogRows, ScriptedAnalogColumns>;
+
+}  // namespace
+
+TEST(SwitchMatrixAnalogScannerTest, Thresholds)
+{
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[2] = {2, 3};
+    Scanner       test_subject(rows, cols);
+    test_subject.setup();
+    // Key 4's magnet is the other way around.
+    test_subject.setCalibration(100, 1100);
+    test_subject.setCalibration(4, 1100, 100);
+    memset(ScriptedAnalogColumns::values, 0, sizeof(ScriptedAnalogColumns::values));
+    ScriptedAnalogColumns::values[1][1] = 1100;
+
+    SwitchEvent events[4];
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ASSERT_EQ(test_subject.getTravel(1), 0U);
+
+    ScriptedAnalogColumns::values[0][0] = 600;
+    ScriptedAnalogColumns::values[1][1] = 600;
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ASSERT_EQ(test_subject.getTravel(1), 127U);
+    ASSERT_EQ(test_subject.getTravel(4), 127U);
+
+    ScriptedAnalogColumns::values[0][0] = 1200;
+    ScriptedAnalogColumns::values[1][1] = 0;
+    ASSERT_EQ(test_subject.scan(events, 4), 2U);
+    ASSERT_EQ(events[0].scancode, 1);
+    ASSERT_EQ(events[0].edge, SwitchEdge::CLOSED);
+    ASSERT_EQ(events[1].scancode, 4);
+    ASSERT_EQ(test_subject.getTravel(1), 255U);
+    ASSERT_TRUE(test_subject.isSwitchClosed(4));
+
+    // Between the release and actuation points nothing changes.
+    ScriptedAnalogColumns::values[0][0] = 600;
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ScriptedAnalogColumns::values[0][0] = 440;
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_FALSE(test_subject.isSwitchClosed(1));
+}
+
+TEST(SwitchMatrixAnalogScannerTest, RapidTrigger)
+{
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[2] = {2, 3};
+    Scanner       test_subject(rows, cols);
+    test_subject.setup();
+    test_subject.setCalibration(0, 255);
+    memset(ScriptedAnalogColumns::values, 0, sizeof(ScriptedAnalogColumns::values));
+    ScriptedAnalogColumns::values[0][1] = 10;
+    test_subject.calibrateRest();
+    test_subject.setThresholds(2, 100, 50, 20);
+
+    SwitchEvent events[4];
+    ScriptedAnalogColumns::values[0][1] = 120;
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 2);
+    ASSERT_EQ(test_subject.getTravel(2), 110U);
+
+    // Lifting by the sensitivity opens the key above the release point, and pressing again closes it.
+    ScriptedAnalogColumns::values[0][1] = 200;
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ScriptedAnalogColumns::values[0][1] = 181;
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ScriptedAnalogColumns::values[0][1] = 170;
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ScriptedAnalogColumns::values[0][1] = 160;
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ScriptedAnalogColumns::values[0][1] = 180;
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::CLOSED);
+
+    // Other keys keep plain thresholds.
+    ScriptedAnalogColumns::values[0][1] = 0;
+    ScriptedAnalogColumns::values[1][0] = 127;
+    ASSERT_EQ(test_subject.scan(events, 1), 1U);
+    ASSERT_EQ(events[0].scancode, 2);
+    ASSERT_EQ(test_subject.scan(events, 1), 0U);
+    ScriptedAnalogColumns::values[1][0] = 128;
+    ASSERT_EQ(test_subject.scan(events, 1), 1U);
+    ASSERT_EQ(events[0].scancode, 3);
+}
+
+namespace
+{
+void logClosed(const gh::thirtytwobits::ScanCodeType (&scancodes)[Scanner::event_buffer_size],
+               size_t scancodes_len,
+               void*  userdata)
+{
+    std::string& log = *static_cast<std::string*>(userdata);
+    log += "C";
+    for (size_t i = 0; i < scancodes_len; ++i)
+    {
+        log += std::to_string(scancodes[i]);
+    }
+    log += " ";
+}
+
+void logOpened(const gh::thirtytwobits::ScanCodeType (&scancodes)[Scanner::event_buffer_size],
+               size_t scancodes_len,
+               void*  userdata)
+{
+    std::string& log = *static_cast<std::string*>(userdata);
+    log += "O";
+    for (size_t i = 0; i < scancodes_len; ++i)
+    {
+        log += std::to_string(scancodes[i]);
+    }
+    log += " ";
+}
+}  // namespace
+
+TEST(SwitchMatrixAnalogScannerTest, EventsLikeTheDigitalScanner)
+{
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[2] = {2, 3};
+    Scanner       test_subject(rows, cols);
+    std::string   log;
+    test_subject.setup(logClosed, logOpened, &log);
+    memset(ScriptedAnalogColumns::values, 0, sizeof(ScriptedAnalogColumns::values));
+
+    // Closes are batched and flushed before opens at the end of the scan.
+    ScriptedAnalogColumns::values[0][0] = 1023;
+    ScriptedAnalogColumns::values[1][1] = 1023;
+    ASSERT_TRUE(test_subject.scan());
+    ScriptedAnalogColumns::values[0][0] = 0;
+    ScriptedAnalogColumns::values[0][1] = 1023;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_EQ(log, "C14 C2 O1 ");
+
+    // A full ring leaves the rest of the changes for a later scan.
+    gh::thirtytwobits::SwitchEventRing<2> ring;
+    SwitchEvent                           events[2];
+    ScriptedAnalogColumns::values[0][1] = 0;
+    ScriptedAnalogColumns::values[1][0] = 1023;
+    ScriptedAnalogColumns::values[1][1] = 0;
+    ASSERT_TRUE(test_subject.scan(ring));
+    ASSERT_EQ(ring.poll(events, 2), 2U);
+    ASSERT_EQ(events[0].scancode, 2);
+    ASSERT_EQ(events[1].scancode, 3);
+    ASSERT_TRUE(test_subject.isSwitchClosed(4));
+    ASSERT_TRUE(test_subject.scan(ring));
+    ASSERT_EQ(ring.poll(events, 2), 1U);
+    ASSERT_EQ(events[0].scancode, 4);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_EQ(log, "C14 C2 O1 ");
+}
@@ -0,0 +1,88 @@
+#include "gmock/gmock.h"
+
+#define INPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT 3
+#define LOW 4
+#define HIGH 5
+
+void digitalWrite(int pin, int level);
+
+int digitalRead(int pin);
+
+void pinMode(int pin, int mode);
+
+unsigned long micros();
+
+#include "SwitchMatrixHidReport.h"
+
+using gh::thirtytwobits::NKeyRollover;
+using gh::thirtytwobits::HidKeyboardReportBuilder;
+using gh::thirtytwobits::SwitchEdge;
+using gh::thirtytwobits::SwitchEvent;
+
+namespace
+{
+// Scancodes 1-8 are a-h, 9 is left shift, and 10 sends nothing.
+const uint8_t keymap[] = {0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0xE1, 0x00};
+}  // namespace
+
+TEST(SwitchMatrixHidReportTest, SixKeyRollover)
+{
+    HidKeyboardReportBuilder<> test_subject(keymap, sizeof(keymap));
+    ASSERT_EQ(sizeof(test_subject.report()), 8U);
+
+    const SwitchEvent presses[] = {{1, SwitchEdge::CLOSED}, {9, SwitchEdge::CLOSED}, {10, SwitchEdge::CLOSED}};
+    ASSERT_TRUE(test_subject.update(presses, 3));
+    ASSERT_EQ(test_subject.report().modifiers, 0x02);
+    ASSERT_EQ(test_subject.report().keys[0], 0x04);
+    ASSERT_EQ(test_subject.report().keys[1], 0x00);
+    ASSERT_FALSE(test_subject.update(presses + 2, 1));
+
+    // Keys keep their slots.
+    ASSERT_TRUE(test_subject.press(2));
+    ASSERT_TRUE(test_subject.release(1));
+    ASSERT_EQ(test_subject.report().keys[0], 0x00);
+    ASSERT_EQ(test_subject.report().keys[1], 0x05);
+    ASSERT_TRUE(test_subject.press(3));
+    ASSERT_EQ(test_subject.report().keys[0], 0x06);
+
+    // A seventh key reports ErrorRollOver until one is released.
+    for (gh::thirtytwobits::ScanCodeType scancode = 4; scancode <= 7; ++scancode)
+    {
+        ASSERT_TRUE(test_subject.press(scancode));
+    }
+    ASSERT_EQ(test_subject.report().keys[5], 0x0A);
+    ASSERT_TRUE(test_subject.press(8));
+    for (size_t i = 0; i < 6; ++i)
+    {
+        ASSERT_EQ(test_subject.report().keys[i], 0x01);
+    }
+    ASSERT_EQ(test_subject.report().modifiers, 0x02);
+    ASSERT_TRUE(test_subject.release(2));
+    for (size_t i = 0; i < 6; ++i)
+    {
+        ASSERT_EQ(test_subject.report().keys[i], 0x06 + i);
+    }
+
+    test_subject.clear();
+    ASSERT_EQ(test_subject.report().modifiers, 0x00);
+    ASSERT_EQ(test_subject.report().keys[0], 0x00);
+}
+
+TEST(SwitchMatrixHidReportTest, NKeyRollover)
+{
+    HidKeyboardReportBuilder<NKeyRollover> test_subject(keymap, sizeof(keymap));
+    ASSERT_EQ(sizeof(test_subject.report()), 29U);
+    for (gh::thirtytwobits::ScanCodeType scancode = 1; scancode <= 9; ++scancode)
+    {
+        ASSERT_TRUE(test_subject.press(scancode));
+    }
+    ASSERT_FALSE(test_subject.press(1));
+    ASSERT_FALSE(test_subject.press(11));
+    ASSERT_EQ(test_subject.report().modifiers, 0x02);
+    ASSERT_EQ(test_subject.report().keys[0], 0xF0);
+    ASSERT_EQ(test_subject.report().keys[1], 0x0F);
+    ASSERT_TRUE(test_subject.release(1));
+    ASSERT_EQ(test_subject.report().keys[0], 0xE0);
+}
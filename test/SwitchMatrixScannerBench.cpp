@@ -0,0 +1,348 @@
+#include "benchmark/benchmark.h"
+#include <stdint.h>
+#include <string.h>
+
+// +--------------------------------------------------------------------------+
+// | Arduino fakes
+// +--------------------------------------------------------------------------+
+// These are defined in this translation unit so the compiler can inline them. The matrix is a plain array of
+// pressed switches and pinMode only tracks which row is being driven.
+
+#define INPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT 3
+#define LOW 4
+#define HIGH 5
+
+namespace
+{
+constexpr int    RowPinBase = 100;
+constexpr size_t MaxRows    = 16;
+constexpr size_t MaxCols    = 32;
+
+int      g_active_row = -1;
+bool     g_pressed[MaxRows][MaxCols];
+uint32_t g_now_us = 0;
+}  // namespace
+
+inline void digitalWrite(int, int) {}
+
+inline int digitalRead(int pin)
+{
+    return (g_active_row >= 0 && g_pressed[g_active_row][pin]) ? LOW : HIGH;
+}
+
+inline void pinMode(int pin, int mode)
+{
+    if (pin >= RowPinBase)
+    {
+        if (mode == OUTPUT)
+        {
+            g_active_row = pin - RowPinBase;
+        }
+        else if (g_active_row == pin - RowPinBase)
+        {
+            g_active_row = -1;
+        }
+    }
+}
+
+inline int analogRead(int pin)
+{
+    return (g_active_row >= 0 && g_pressed[g_active_row][pin]) ? 1000 : 20;
+}
+
+inline unsigned long micros()
+{
+    return g_now_us;
+}
+
+#include "SwitchMatrixScanner.h"
+#include "SwitchMatrixAnalogScanner.h"
+#include "SwitchMatrixTraceReplay.h"
+
+using namespace gh::thirtytwobits;
+
+namespace
+{
+struct BenchClock
+{
+    static uint32_t now()
+    {
+        return g_now_us;
+    }
+};
+
+using Counted = CountedDebounce<>;
+using Timed   = TimedDebounce<5000, BenchClock>;
+using Eager   = EagerDebounce<>;
+
+// How many scans a pattern is held before it is released (and then how long it stays released).
+constexpr size_t TogglePeriod = 16;
+// Simulated scan period for TimedDebounce.
+constexpr uint32_t ScanPeriodUs = 1000;
+
+template <size_t ROWS, size_t COLS>
+struct Pins
+{
+    Pins()
+    {
+        for (size_t r = 0; r < ROWS; ++r)
+        {
+            rows[r] = static_cast<uint8_t>(RowPinBase + r);
+        }
+        for (size_t c = 0; c < COLS; ++c)
+        {
+            cols[c] = static_cast<uint8_t>(c);
+        }
+    }
+    uint8_t rows[ROWS];
+    uint8_t cols[COLS];
+};
+
+/*
+ * Presses about density_percent of the switches in a fixed pseudo-random pattern.
+ */
+void set_pattern(size_t rows, size_t cols, int density_percent, bool pressed)
+{
+    memset(g_pressed, 0, sizeof(g_pressed));
+    if (!pressed)
+    {
+        return;
+    }
+    uint32_t lfsr = 0xACE1u;
+    for (size_t r = 0; r < rows; ++r)
+    {
+        for (size_t c = 0; c < cols; ++c)
+        {
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);
+            g_pressed[r][c] = (static_cast<int>(lfsr % 100) < density_percent);
+        }
+    }
+}
+
+void count_events(const ScanCodeType (&)[10], size_t scancodes_len, void* userdata)
+{
+    *static_cast<size_t*>(userdata) += scancodes_len;
+}
+
+/*
+ * Adds a time-per-switch counter next to the time-per-iteration google benchmark always reports.
+ */
+void report_per_switch(benchmark::State& state, size_t switch_count)
+{
+    state.counters["per_switch"] = benchmark::Counter(static_cast<double>(switch_count),
+                                                      benchmark::Counter::kIsIterationInvariantRate |
+                                                          benchmark::Counter::kInvert);
+}
+}  // namespace
+
+// +--------------------------------------------------------------------------+
+// | BENCHMARKS
+// +--------------------------------------------------------------------------+
+/*
+ * Time per scan() call. The argument is the percentage of switches in the pressed pattern. The pattern is
+ * pressed and released every TogglePeriod scans so the debounce logic has work to do. 0 is an idle matrix.
+ */
+template <size_t ROWS, size_t COLS, typename DEBOUNCE>
+void BM_Scan(benchmark::State& state)
+{
+    const int                                                  density = static_cast<int>(state.range(0));
+    Pins<ROWS, COLS>                                           pins;
+    SwitchMatrixScanner<ROWS, COLS, 10, ArduinoPins, DEBOUNCE> scanner(pins.rows, pins.cols);
+    size_t                                                     events = 0;
+    scanner.setup(count_events, count_events, &events);
+    set_pattern(ROWS, COLS, density, false);
+    size_t scans = 0;
+    for (auto _ : state)
+    {
+        if (scans % TogglePeriod == 0)
+        {
+            set_pattern(ROWS, COLS, density, (scans / TogglePeriod) % 2 == 0);
+        }
+        g_now_us += ScanPeriodUs;
+        benchmark::DoNotOptimize(scanner.scan());
+        ++scans;
+    }
+    report_per_switch(state, ROWS * COLS);
+    state.counters["events"] = benchmark::Counter(static_cast<double>(events), benchmark::Counter::kAvgIterations);
+}
+
+#define SCAN_BENCHMARKS(ROWS, COLS)                                                     \
+    BENCHMARK_TEMPLATE(BM_Scan, ROWS, COLS, Counted)->Arg(0)->Arg(1)->Arg(10)->Arg(50); \
+    BENCHMARK_TEMPLATE(BM_Scan, ROWS, COLS, Timed)->Arg(0)->Arg(1)->Arg(10)->Arg(50);   \
+    BENCHMARK_TEMPLATE(BM_Scan, ROWS, COLS, Eager)->Arg(0)->Arg(1)->Arg(10)->Arg(50);   \
+    BENCHMARK_TEMPLATE(BM_Scan, ROWS, COLS, NoDebounce)->Arg(0)->Arg(1)->Arg(10)->Arg(50)
+
+SCAN_BENCHMARKS(1, 1);
+SCAN_BENCHMARKS(2, 7);
+SCAN_BENCHMARKS(6, 18);
+SCAN_BENCHMARKS(16, 16);
+
+/*
+ * BM_Scan with the event counter passed to scanWith as a lambda instead of through setup's function pointers.
+ */
+template <size_t ROWS, size_t COLS>
+void BM_ScanWith(benchmark::State& state)
+{
+    const int                                        density = static_cast<int>(state.range(0));
+    Pins<ROWS, COLS>                                 pins;
+    SwitchMatrixScanner<ROWS, COLS, 10, ArduinoPins> scanner(pins.rows, pins.cols);
+    size_t                                           events       = 0;
+    auto count_inline = [&events](const ScanCodeType (&)[10], size_t scancodes_len) { events += scancodes_len; };
+    scanner.setup();
+    set_pattern(ROWS, COLS, density, false);
+    size_t scans = 0;
+    for (auto _ : state)
+    {
+        if (scans % TogglePeriod == 0)
+        {
+            set_pattern(ROWS, COLS, density, (scans / TogglePeriod) % 2 == 0);
+        }
+        g_now_us += ScanPeriodUs;
+        benchmark::DoNotOptimize(scanner.scanWith(count_inline, count_inline));
+        ++scans;
+    }
+    report_per_switch(state, ROWS * COLS);
+    state.counters["events"] = benchmark::Counter(static_cast<double>(events), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_TEMPLATE(BM_ScanWith, 6, 18)->Arg(0)->Arg(10)->Arg(50);
+
+/*
+ * Time for one debounce policy to update one row, without any pin access. The argument is the number of
+ * switches in the row that toggle between samples.
+ */
+template <size_t COLS, typename DEBOUNCE>
+void BM_DebounceRow(benchmark::State& state)
+{
+    using RowMask = typename RowMaskTraits<COLS>::type;
+    const size_t                                   toggling = static_cast<size_t>(state.range(0));
+    const RowMask                                  toggle   = static_cast<RowMask>(column_mask<RowMask>(toggling));
+    typename DEBOUNCE::template Row<COLS, RowMask> row;
+    RowMask                                        sample = 0;
+    uint32_t                                       now    = 0;
+    for (auto _ : state)
+    {
+        RowMask closed;
+        RowMask open;
+        row.update(sample, now, closed, open);
+        benchmark::DoNotOptimize(closed);
+        benchmark::DoNotOptimize(open);
+        sample = static_cast<RowMask>(sample ^ toggle);
+        now += ScanPeriodUs;
+    }
+    report_per_switch(state, COLS);
+}
+
+BENCHMARK_TEMPLATE(BM_DebounceRow, 18, Counted)->Arg(0)->Arg(1)->Arg(18);
+BENCHMARK_TEMPLATE(BM_DebounceRow, 18, Timed)->Arg(0)->Arg(1)->Arg(18);
+BENCHMARK_TEMPLATE(BM_DebounceRow, 18, Eager)->Arg(0)->Arg(1)->Arg(18);
+
+/*
+ * Key-down latency from idle mode: each iteration presses a key on an idle matrix and scans until it is
+ * reported. The scans_to_keydown counter is the latency in scan periods.
+ */
+template <size_t ROWS, size_t COLS, typename DEBOUNCE>
+void BM_IdleKeyDownLatency(benchmark::State& state)
+{
+    Pins<ROWS, COLS>                                           pins;
+    SwitchMatrixScanner<ROWS, COLS, 10, ArduinoPins, DEBOUNCE> scanner(pins.rows, pins.cols);
+    scanner.setup();
+    scanner.setIdleModeEnabled(true);
+    set_pattern(ROWS, COLS, 0, false);
+    while (!scanner.isIdle())
+    {
+        g_now_us += ScanPeriodUs;
+        scanner.scan();
+    }
+    size_t scans = 0;
+    for (auto _ : state)
+    {
+        g_pressed[ROWS - 1][COLS - 1] = true;
+        while (!scanner.isSwitchClosed(ROWS * COLS))
+        {
+            g_now_us += ScanPeriodUs;
+            scanner.scan();
+            ++scans;
+        }
+        state.PauseTiming();
+        g_pressed[ROWS - 1][COLS - 1] = false;
+        while (!scanner.isIdle())
+        {
+            g_now_us += ScanPeriodUs;
+            scanner.scan();
+        }
+        state.ResumeTiming();
+    }
+    state.counters["scans_to_keydown"] =
+        benchmark::Counter(static_cast<double>(scans), benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_TEMPLATE(BM_IdleKeyDownLatency, 6, 18, Counted);
+BENCHMARK_TEMPLATE(BM_IdleKeyDownLatency, 6, 18, Timed);
+BENCHMARK_TEMPLATE(BM_IdleKeyDownLatency, 6, 18, Eager);
+BENCHMARK_TEMPLATE(BM_IdleKeyDownLatency, 6, 18, NoDebounce);
+
+/*
+ * Time per AnalogSwitchMatrixScanner::scan() call with analogRead faked out, so this is the cost of the travel
+ * conversion and thresholds alone. The argument is the rapid trigger sensitivity (0 for off). For 80 keys at
+ * 1 kHz this plus the ADC conversions must fit in a millisecond.
+ */
+template <size_t ROWS, size_t COLS>
+void BM_AnalogScan(benchmark::State& state)
+{
+    Pins<ROWS, COLS>                      pins;
+    AnalogSwitchMatrixScanner<ROWS, COLS> scanner(pins.rows, pins.cols);
+    size_t                                events = 0;
+    scanner.setup(count_events, count_events, &events);
+    scanner.setThresholds(128, 102, static_cast<uint8_t>(state.range(0)));
+    set_pattern(ROWS, COLS, 10, false);
+    size_t scans = 0;
+    for (auto _ : state)
+    {
+        if (scans % TogglePeriod == 0)
+        {
+            set_pattern(ROWS, COLS, 10, (scans / TogglePeriod) % 2 == 0);
+        }
+        benchmark::DoNotOptimize(scanner.scan());
+        ++scans;
+    }
+    report_per_switch(state, ROWS * COLS);
+}
+
+BENCHMARK_TEMPLATE(BM_AnalogScan, 8, 10)->Arg(0)->Arg(20);
+
+/*
+ * Replays a synthetic trace (a press every 20ms held for 50ms, with up to range(0) us of bounce, sampled every
+ * 250us) through each debounce policy. Reports replayed frames per second along with the event latency and
+ * the missed and duplicate events, so a parameter sweep is one run.
+ */
+template <size_t ROWS, size_t COLS, typename DEBOUNCE>
+void BM_TraceReplay(benchmark::State& state)
+{
+    TraceBuffer trace;
+    synthesize_trace<ROWS, COLS>(
+        trace, SyntheticTraceOptions{100000, 250, 20000, 50000, static_cast<uint32_t>(state.range(0)), 1});
+    Pins<ROWS, COLS>  pins;
+    TraceReplayReport report = TraceReplayReport();
+    uint64_t          frames = 0;
+    for (auto _ : state)
+    {
+        SwitchMatrixScanner<ROWS, COLS, 10, TracePins, DEBOUNCE> scanner(pins.rows, pins.cols);
+        scanner.setup();
+        report = replay_trace(scanner, trace.bytes.data(), trace.bytes.size());
+        frames += report.frames;
+    }
+    state.counters["frames"]     = benchmark::Counter(static_cast<double>(frames), benchmark::Counter::kIsRate);
+    state.counters["p50_us"]     = static_cast<double>(report.latency_p50_us);
+    state.counters["p99_us"]     = static_cast<double>(report.latency_p99_us);
+    state.counters["missed"]     = static_cast<double>(report.missed);
+    state.counters["duplicates"] = static_cast<double>(report.duplicates);
+}
+
+using TraceTimed = TimedDebounce<5000, TraceClock>;
+
+BENCHMARK_TEMPLATE(BM_TraceReplay, 6, 18, Counted)->Arg(500)->Arg(2000);
+BENCHMARK_TEMPLATE(BM_TraceReplay, 6, 18, TraceTimed)->Arg(500)->Arg(2000);
+BENCHMARK_TEMPLATE(BM_TraceReplay, 6, 18, Eager)->Arg(500)->Arg(2000);
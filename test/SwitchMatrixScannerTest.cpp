@@ -1,6 +1,8 @@
 
 #include "gmock/gmock.h"
 #include <memory>
+#include <string>
+#include <vector>
 
 using ::testing::Return;
 using ::testing::_;
@@ -21,7 +23,14 @@ int digitalRead(int pin);
 
 void pinMode(int pin, int mode);
 
+unsigned long micros();
+
 #include "SwitchMatrixScanner.h"
+#include "SwitchMatrixSplitLink.h"
+#include "SwitchMatrixScanGroup.h"
+#include "SwitchMatrixCombos.h"
+#include "SwitchMatrixShiftRegisterRows.h"
+#include "SwitchMatrixMcp23017Columns.h"
 
 struct ArduinoState
 {
@@ -98,7 +107,7 @@ public:
 
     static SwitchMatrixScannerTest<T>* current_test;
 
-    static void onSwitchClosed(const uint16_t (&scancodes)[T::event_buffer_size], size_t scancodes_len)
+    static void onSwitchClosed(const uint16_t (&scancodes)[T::event_buffer_size], size_t scancodes_len, void*)
     {
         SwitchMatrixScannerTest<T>* t = current_test;
         ASSERT_NE(t, nullptr);
@@ -107,7 +116,7 @@ public:
         mock->onSwitchClosed(scancodes, scancodes_len);
     }
 
-    static void onSwitchOpen(const uint16_t (&scancodes)[T::event_buffer_size], size_t scancodes_len)
+    static void onSwitchOpen(const uint16_t (&scancodes)[T::event_buffer_size], size_t scancodes_len, void*)
     {
         SwitchMatrixScannerTest<T>* t = current_test;
         ASSERT_NE(t, nullptr);
@@ -139,6 +148,14 @@ void pinMode(int pin, int mode)
     mock->pinMode(pin, mode);
 }
 
+// Advances by one microsecond every time it is read.
+unsigned long fake_micros = 0;
+
+unsigned long micros()
+{
+    return fake_micros++;
+}
+
 TYPED_TEST_SUITE_P(SwitchMatrixScannerTest);
 
 // +--------------------------------------------------------------------------+
@@ -162,6 +179,44 @@ TYPED_TEST_P(SwitchMatrixScannerTest, KeyUP)
     ASSERT_FALSE(test_subject.isSwitchClosed(1));
 }
 
+TYPED_TEST_P(SwitchMatrixScannerTest, KeyUPDebounced)
+{
+    TypeParam         test_subject(this->row, this->col, true, true);
+    MockArduinoState* mock;
+    this->get_mock(mock);
+    test_subject.setup(SwitchMatrixScannerTest<TypeParam>::onSwitchClosed,
+                       SwitchMatrixScannerTest<TypeParam>::onSwitchOpen);
+    EXPECT_CALL(*mock, digitalRead(this->col[0])).WillRepeatedly(Return(LOW));
+    EXPECT_CALL(*mock, digitalRead(::testing::Ne(this->col[0]))).WillRepeatedly(Return(HIGH));
+    EXPECT_CALL(*mock, onSwitchClosed(_, _)).Times(0);
+    // One settle scan while the state is discovered, one more because discovering a state restarts the
+    // settle window, then DebounceSampleCount samples.
+    for (size_t i = 0; i < 3; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+        ASSERT_FALSE(test_subject.isSwitchClosed(1));
+    }
+    ::testing::Mock::VerifyAndClearExpectations(mock);
+    EXPECT_CALL(*mock, digitalRead(this->col[0])).WillRepeatedly(Return(LOW));
+    EXPECT_CALL(*mock, digitalRead(::testing::Ne(this->col[0]))).WillRepeatedly(Return(HIGH));
+    EXPECT_CALL(*mock, onSwitchClosed(_, TypeParam::row_count)).Times(1);
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    ::testing::Mock::VerifyAndClearExpectations(mock);
+    EXPECT_CALL(*mock, digitalRead(_)).WillRepeatedly(Return(HIGH));
+    EXPECT_CALL(*mock, onSwitchOpen(_, _)).Times(0);
+    for (size_t i = 0; i < 2; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+        ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    }
+    ::testing::Mock::VerifyAndClearExpectations(mock);
+    EXPECT_CALL(*mock, digitalRead(_)).WillRepeatedly(Return(HIGH));
+    EXPECT_CALL(*mock, onSwitchOpen(_, TypeParam::row_count)).Times(1);
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(1));
+}
+
 TYPED_TEST_P(SwitchMatrixScannerTest, SetupPullups)
 {
     TypeParam         test_subject(this->row, this->col, true);
@@ -195,9 +250,1487 @@ TYPED_TEST_P(SwitchMatrixScannerTest, SetupNoPullups)
 }
 
 // +--------------------------------------------------------------------------+
-REGISTER_TYPED_TEST_SUITE_P(SwitchMatrixScannerTest, SetupPullups, SetupNoPullups, KeyUP);
+REGISTER_TYPED_TEST_SUITE_P(SwitchMatrixScannerTest, SetupPullups, SetupNoPullups, KeyUP, KeyUPDebounced);
 
 using MatrixTestTypes =
     ::testing::Types<gh::thirtytwobits::SwitchMatrixScanner<1, 1>, gh::thirtytwobits::SwitchMatrixScanner<2, 3>>;
 
 INSTANTIATE_TYPED_TEST_SUITE_P(My, SwitchMatrixScannerTest, MatrixTestTypes);
+
+TEST(SwitchMatrixRowDriveTest, PushPullRowsOnlyWrite)
+{
+    using ::testing::InSequence;
+    using Rows = gh::thirtytwobits::DrivenRows<gh::thirtytwobits::RowDrive::PUSH_PULL>;
+    using Pins = gh::thirtytwobits::SplitPins<Rows, gh::thirtytwobits::ArduinoColumns>;
+    const uint8_t rows[2] = {3, 4};
+    const uint8_t cols[3] = {0, 1, 2};
+    mock_state.reset(new ::testing::NiceMock<MockArduinoState>());
+    ON_CALL(*mock_state, digitalRead(_)).WillByDefault(Return(HIGH));
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, Pins> test_subject(rows, cols);
+    EXPECT_CALL(*mock_state, pinMode(::testing::Lt(3), INPUT_PULLUP)).Times(3);
+    {
+        InSequence in_order;
+        for (const uint8_t pin : rows)
+        {
+            EXPECT_CALL(*mock_state, digitalWrite(pin, HIGH));
+            EXPECT_CALL(*mock_state, pinMode(pin, OUTPUT));
+        }
+    }
+    test_subject.setup();
+    ::testing::Mock::VerifyAndClearExpectations(mock_state.get());
+
+    // One write per row change and no mode changes. Every row is back HIGH at the end of the frame.
+    EXPECT_CALL(*mock_state, pinMode(_, _)).Times(0);
+    {
+        InSequence in_order;
+        EXPECT_CALL(*mock_state, digitalWrite(3, LOW));
+        EXPECT_CALL(*mock_state, digitalWrite(3, HIGH));
+        EXPECT_CALL(*mock_state, digitalWrite(4, LOW));
+        EXPECT_CALL(*mock_state, digitalWrite(4, HIGH));
+    }
+    test_subject.scan();
+    ::testing::Mock::VerifyAndClearExpectations(mock_state.get());
+    mock_state.reset();
+}
+
+// +--------------------------------------------------------------------------+
+// | SCRIPTED SAMPLE TESTS
+// +--------------------------------------------------------------------------+
+/**
+ * Pin access policy that returns scripted row samples and records which row is driven.
+ */
+struct ScriptedPins
+{
+    static uint32_t row_samples[8];
+    static int      selected_row;
+    static size_t   select_count;
+
+    static void reset()
+    {
+        memset(row_samples, 0, sizeof(row_samples));
+        selected_row = -1;
+        select_count = 0;
+        arm_count    = 0;
+        on_arm       = nullptr;
+        selected_at  = 0;
+        min_settle   = ~0UL;
+    }
+
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&)[ROW_COUNT], const uint8_t (&)[COL_COUNT]) {}
+
+        void setup(uint8_t) {}
+
+        void selectRow(size_t row)
+        {
+            EXPECT_EQ(selected_row, -1);
+            selected_row = static_cast<int>(row);
+            selected_at  = micros();
+            ++select_count;
+        }
+
+        void releaseRow(size_t row)
+        {
+            EXPECT_EQ(selected_row, static_cast<int>(row));
+            selected_row = -1;
+        }
+
+        void selectAllRows()
+        {
+            EXPECT_EQ(selected_row, -1);
+            selected_row = all_rows;
+        }
+
+        void releaseAllRows()
+        {
+            EXPECT_EQ(selected_row, all_rows);
+            selected_row = -1;
+        }
+
+        RowMask readColumns() const
+        {
+            EXPECT_NE(selected_row, -1);
+            const unsigned long settled = micros() - selected_at;
+            min_settle                  = (settled < min_settle) ? settled : min_settle;
+            if (selected_row == all_rows)
+            {
+                uint32_t any_row = 0;
+                for (size_t r = 0; r < ROW_COUNT; ++r)
+                {
+                    any_row |= row_samples[r];
+                }
+                return static_cast<RowMask>(any_row);
+            }
+            return static_cast<RowMask>(row_samples[selected_row]);
+        }
+
+        bool armWake(void (*)())
+        {
+            ++arm_count;
+            if (on_arm != nullptr)
+            {
+                on_arm();
+            }
+            return false;
+        }
+
+        void disarmWake() {}
+    };
+
+    static constexpr int all_rows = -2;
+    static size_t        arm_count;
+    // Called from armWake, to change the samples while the scanner goes idle.
+    static void (*on_arm)();
+    static unsigned long selected_at;
+    // Shortest time between selectRow and readColumns.
+    static unsigned long min_settle;
+};
+
+uint32_t      ScriptedPins::row_samples[8] = {0};
+int           ScriptedPins::selected_row   = -1;
+size_t        ScriptedPins::select_count   = 0;
+size_t        ScriptedPins::arm_count      = 0;
+void (*ScriptedPins::on_arm)()              = nullptr;
+unsigned long ScriptedPins::selected_at    = 0;
+unsigned long ScriptedPins::min_settle     = 0;
+constexpr int ScriptedPins::all_rows;
+
+TEST(SwitchMatrixScannerScriptedTest, RowSamplesMapToScancodes)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[3] = {0, 1, 2};
+    const uint8_t cols[5] = {3, 4, 5, 6, 7};
+    gh::thirtytwobits::SwitchMatrixScanner<3, 5, 10, ScriptedPins> test_subject(rows, cols, true, false);
+    test_subject.setup();
+    ScriptedPins::row_samples[0] = 0x01;
+    ScriptedPins::row_samples[2] = 0x12;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_EQ(ScriptedPins::select_count, 3U);
+    ASSERT_EQ(ScriptedPins::selected_row, -1);
+    for (uint16_t scancode = 1; scancode <= 15; ++scancode)
+    {
+        const bool expected = (scancode == 1 || scancode == 12 || scancode == 15);
+        ASSERT_EQ(test_subject.isSwitchClosed(scancode), expected) << "scancode " << scancode;
+    }
+}
+
+TEST(SwitchMatrixScannerScriptedTest, HeldKeyFinishesSettling)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins> test_subject(rows, cols);
+    test_subject.setup();
+    ScriptedPins::row_samples[1] = 0x04;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+    }
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(6));
+    // The settle window that started when the switch closed must keep running even though the
+    // samples now match the stable state.
+    for (size_t i = 0; i < 5; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+    }
+    ScriptedPins::row_samples[1] = 0;
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(6));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, IdleMode)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins> test_subject(rows, cols);
+    test_subject.setup();
+    test_subject.setIdleModeEnabled(true);
+    for (size_t i = 0; i < 2 && !test_subject.isIdle(); ++i)
+    {
+        test_subject.scan();
+    }
+    ASSERT_TRUE(test_subject.isIdle());
+    ASSERT_EQ(ScriptedPins::arm_count, 1U);
+    ASSERT_FALSE(test_subject.canWakeFromSleep());
+    ScriptedPins::select_count = 0;
+    for (size_t i = 0; i < 10; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+        ASSERT_TRUE(test_subject.isIdle());
+    }
+    ASSERT_EQ(ScriptedPins::select_count, 0U);
+
+    // Any LOW column leaves idle mode and resumes scanning.
+    ScriptedPins::row_samples[1] = 0x02;
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isIdle());
+    ASSERT_EQ(ScriptedPins::selected_row, -1);
+    ASSERT_EQ(ScriptedPins::select_count, 2U);
+    for (size_t i = 0; i < 2 && !test_subject.isSwitchClosed(5); ++i)
+    {
+        test_subject.scan();
+    }
+    ASSERT_TRUE(test_subject.isSwitchClosed(5));
+    ASSERT_FALSE(test_subject.isIdle());
+
+    ScriptedPins::row_samples[1] = 0;
+    for (size_t i = 0; i < 4 && !test_subject.isIdle(); ++i)
+    {
+        test_subject.scan();
+    }
+    ASSERT_FALSE(test_subject.isSwitchClosed(5));
+    ASSERT_TRUE(test_subject.isIdle());
+    ASSERT_EQ(ScriptedPins::arm_count, 2U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, IdleSeesSwitchClosedWhileArming)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    test_subject.setup();
+    test_subject.setIdleModeEnabled(true);
+    // Row 0 closes after it was scanned in the quiet frame, so its column is already LOW once the interrupts
+    // are armed and no edge will come.
+    ScriptedPins::on_arm = [] { ScriptedPins::row_samples[0] = 0x01; };
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_EQ(ScriptedPins::arm_count, 1U);
+    ASSERT_FALSE(test_subject.isIdle());
+    ScriptedPins::on_arm = nullptr;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    ASSERT_FALSE(test_subject.isIdle());
+}
+
+/**
+ * Pin access policy for an open matrix whose column interrupts can be fired by hand.
+ */
+struct WakePins
+{
+    // The handlers passed to armWake, in call order.
+    static std::vector<void (*)()> armed;
+
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&)[ROW_COUNT], const uint8_t (&)[COL_COUNT]) {}
+
+        void setup(uint8_t) {}
+        void selectRow(size_t) {}
+        void releaseRow(size_t) {}
+        void selectAllRows() {}
+        void releaseAllRows() {}
+
+        RowMask readColumns() const
+        {
+            return 0;
+        }
+
+        bool armWake(void (*isr)())
+        {
+            armed.push_back(isr);
+            return true;
+        }
+
+        void disarmWake() {}
+    };
+};
+
+std::vector<void (*)()> WakePins::armed;
+
+TEST(SwitchMatrixScannerScriptedTest, IdleWakeIsPerInstance)
+{
+    WakePins::armed.clear();
+    const uint8_t rows[1] = {0};
+    const uint8_t cols[2] = {1, 2};
+    using Scanner         = gh::thirtytwobits::SwitchMatrixScanner<1, 2, 10, WakePins>;
+    Scanner first(rows, cols, true, false);
+    Scanner second(rows, cols, true, false);
+    first.setup();
+    second.setup();
+    first.setIdleModeEnabled(true);
+    second.setIdleModeEnabled(true);
+    first.scan();
+    second.scan();
+    ASSERT_TRUE(first.isIdle());
+    ASSERT_TRUE(second.isIdle());
+    ASSERT_TRUE(second.canWakeFromSleep());
+    ASSERT_EQ(WakePins::armed.size(), 2U);
+    ASSERT_NE(WakePins::armed[0], WakePins::armed[1]);
+
+    // Only the scanner whose interrupt fired wakes up. It finds the matrix open and goes idle again, arming
+    // its interrupt a second time.
+    WakePins::armed[0]();
+    second.scan();
+    ASSERT_EQ(WakePins::armed.size(), 2U);
+    first.scan();
+    ASSERT_EQ(WakePins::armed.size(), 3U);
+    ASSERT_EQ(WakePins::armed[2], WakePins::armed[0]);
+    ASSERT_TRUE(first.isIdle());
+
+    WakePins::armed[1]();
+    first.scan();
+    ASSERT_EQ(WakePins::armed.size(), 3U);
+    second.scan();
+    ASSERT_EQ(WakePins::armed.size(), 4U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, RingDefersWhenFull)
+{
+    ScriptedPins::reset();
+    using gh::thirtytwobits::SwitchEdge;
+    using gh::thirtytwobits::SwitchEvent;
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins> test_subject(rows, cols, true, false);
+    gh::thirtytwobits::SwitchEventRing<2>                           ring;
+    test_subject.setup();
+    ASSERT_FALSE(test_subject.scan(ring));
+    ScriptedPins::row_samples[0] = 0x04;
+    ScriptedPins::row_samples[1] = 0x03;
+    ASSERT_TRUE(test_subject.scan(ring));
+    ASSERT_EQ(ring.room(), 0U);
+    ASSERT_TRUE(test_subject.isSwitchClosed(3));
+    ASSERT_TRUE(test_subject.isSwitchClosed(4));
+    ASSERT_FALSE(test_subject.isSwitchClosed(5));
+    ASSERT_FALSE(test_subject.scan(ring));
+
+    SwitchEvent events[4];
+    ASSERT_EQ(ring.poll(events, 4), 2U);
+    ASSERT_EQ(events[0].scancode, 3U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::CLOSED);
+    ASSERT_EQ(events[1].scancode, 4U);
+    ASSERT_TRUE(ring.empty());
+
+    ScriptedPins::row_samples[0] = 0;
+    ASSERT_TRUE(test_subject.scan(ring));
+    ASSERT_EQ(ring.poll(events, 4), 2U);
+    ASSERT_EQ(events[0].scancode, 3U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_EQ(events[1].scancode, 5U);
+    ASSERT_EQ(events[1].edge, SwitchEdge::CLOSED);
+    ASSERT_TRUE(test_subject.isSwitchClosed(5));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, StateSnapshot)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    gh::thirtytwobits::SwitchStateSnapshot<2, 3> snapshot;
+    using Bitmap = decltype(snapshot)::Bitmap;
+    test_subject.setup();
+    Bitmap previous = {};
+    Bitmap current;
+    ASSERT_FALSE(snapshot.read(current));
+    ASSERT_FALSE(current.any());
+
+    ScriptedPins::row_samples[0] = 0x05;
+    ASSERT_TRUE(test_subject.scan(snapshot));
+    // Nothing is published while nothing changes.
+    ASSERT_FALSE(test_subject.scan(snapshot));
+    ASSERT_TRUE(snapshot.read(current));
+    ASSERT_FALSE(snapshot.read(current));
+    ASSERT_TRUE(current.isSwitchClosed(1));
+    ASSERT_FALSE(current.isSwitchClosed(2));
+    ASSERT_FALSE(current.isSwitchClosed(7));
+    gh::thirtytwobits::ScanCodeType scancodes[6];
+    ASSERT_EQ(current.pressedSince(previous).scancodes(scancodes, 6), 2U);
+    ASSERT_EQ(scancodes[0], 1U);
+    ASSERT_EQ(scancodes[1], 3U);
+    ASSERT_FALSE(current.releasedSince(previous).any());
+    previous = current;
+
+    // Reads see only the latest of several scans.
+    ScriptedPins::row_samples[0] = 0x01;
+    ScriptedPins::row_samples[1] = 0x04;
+    ASSERT_TRUE(test_subject.scan(snapshot));
+    ScriptedPins::row_samples[1] = 0x02;
+    ASSERT_TRUE(test_subject.scan(snapshot));
+    ASSERT_TRUE(snapshot.read(current));
+    ASSERT_EQ(current.pressedSince(previous).scancodes(scancodes, 6), 1U);
+    ASSERT_EQ(scancodes[0], 5U);
+    ASSERT_EQ(current.releasedSince(previous).scancodes(scancodes, 6), 1U);
+    ASSERT_EQ(scancodes[0], 3U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, CallableHandlers)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    // A two scancode buffer so a full row flushes early.
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 2, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    using ScanCodes = const gh::thirtytwobits::ScanCodeType (&)[decltype(test_subject)::event_buffer_size];
+    test_subject.setup();
+    std::vector<int> events;
+    std::vector<int> batches;
+    auto on_closed = [&](ScanCodes scancodes, size_t scancodes_len) {
+        events.insert(events.end(), scancodes, scancodes + scancodes_len);
+        batches.push_back(static_cast<int>(scancodes_len));
+    };
+    auto on_open = [&](ScanCodes scancodes, size_t scancodes_len) {
+        for (size_t i = 0; i < scancodes_len; ++i)
+        {
+            events.push_back(-scancodes[i]);
+        }
+    };
+
+    ScriptedPins::row_samples[0] = 0x07;
+    ASSERT_TRUE(test_subject.scanWith(on_closed, on_open));
+    ASSERT_EQ(events, std::vector<int>({1, 2, 3}));
+    ASSERT_EQ(batches, std::vector<int>({2, 1}));
+
+    events.clear();
+    ScriptedPins::row_samples[0] = 0x06;
+    ScriptedPins::row_samples[1] = 0x01;
+    ASSERT_FALSE(test_subject.scanRowsWith(1, on_closed, on_open));
+    ASSERT_EQ(events, std::vector<int>({-1}));
+    ASSERT_TRUE(test_subject.scanRowsWith(1, on_closed, on_open));
+    ASSERT_EQ(events, std::vector<int>({-1, 4}));
+
+    // Without an open handler releases are dropped.
+    events.clear();
+    ScriptedPins::row_samples[0] = 0;
+    ScriptedPins::row_samples[1] = 0x03;
+    ASSERT_TRUE(test_subject.scanWith(on_closed));
+    ASSERT_EQ(events, std::vector<int>({5}));
+}
+
+struct FakeClock
+{
+    static uint32_t now_us;
+    static void     begin() {}
+    static uint32_t now()
+    {
+        return now_us;
+    }
+};
+
+uint32_t FakeClock::now_us = 0;
+
+TEST(SwitchMatrixScannerScriptedTest, TimedDebounce)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    using Debounce = gh::thirtytwobits::TimedDebounce<1000, FakeClock>;
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins, Debounce> test_subject(rows, cols);
+    test_subject.setup();
+    FakeClock::now_us = 0xFFFFFF00U;  // start just before the 16-bit timestamps wrap
+    ASSERT_FALSE(test_subject.scan());
+    FakeClock::now_us += 1000;
+    ASSERT_FALSE(test_subject.scan());
+
+    // Press with a bounce. The window restarts at every change.
+    ScriptedPins::row_samples[1] = 0x01;
+    ASSERT_FALSE(test_subject.scan());
+    FakeClock::now_us += 300;
+    ScriptedPins::row_samples[1] = 0;
+    ASSERT_FALSE(test_subject.scan());
+    FakeClock::now_us += 100;
+    ScriptedPins::row_samples[1] = 0x01;
+    ASSERT_FALSE(test_subject.scan());
+    FakeClock::now_us += 999;
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(4));
+    FakeClock::now_us += 1;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(4));
+
+    // The scan rate doesn't matter. One scan after the window is enough.
+    ScriptedPins::row_samples[1] = 0;
+    FakeClock::now_us += 5000;
+    ASSERT_FALSE(test_subject.scan());
+    FakeClock::now_us += 1000;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(4));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, EagerDebounce)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[1] = {0};
+    const uint8_t cols[2] = {1, 2};
+    using Debounce        = gh::thirtytwobits::EagerDebounce<3, 2>;
+    gh::thirtytwobits::SwitchMatrixScanner<1, 2, 10, ScriptedPins, Debounce> test_subject(rows, cols);
+    test_subject.setup();
+    // Discovering the initial state also starts the lock window.
+    for (size_t i = 0; i < 4; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+    }
+
+    // The first closed sample is reported immediately.
+    ScriptedPins::row_samples[0] = 0x02;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(2));
+
+    // Bounces inside the lock window are ignored.
+    const uint32_t bounce[] = {0, 0x02, 0};
+    for (size_t i = 0; i < 3; ++i)
+    {
+        ScriptedPins::row_samples[0] = bounce[i];
+        ASSERT_FALSE(test_subject.scan());
+        ASSERT_TRUE(test_subject.isSwitchClosed(2));
+    }
+
+    // Releases need RELEASE_SAMPLES open samples.
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(2));
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(2));
+}
+
+struct SlowSwitches : gh::thirtytwobits::DefaultDebounceTraits
+{
+    static constexpr const uint8_t DebounceSettleCount = 0;
+    static constexpr const uint8_t DebounceSampleCount = 4;
+};
+
+TEST(SwitchMatrixScannerScriptedTest, DebounceTraits)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[1] = {0};
+    const uint8_t cols[2] = {1, 2};
+    using Debounce        = gh::thirtytwobits::CountedDebounce<SlowSwitches>;
+    gh::thirtytwobits::SwitchMatrixScanner<1, 2, 10, ScriptedPins, Debounce> test_subject(rows, cols);
+    test_subject.setup();
+    ScriptedPins::row_samples[0] = 0x01;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+    }
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, NoDebounce)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[1] = {0};
+    const uint8_t cols[2] = {1, 2};
+    gh::thirtytwobits::SwitchMatrixScanner<1, 2, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    test_subject.setup();
+    ScriptedPins::row_samples[0] = 0x01;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    ScriptedPins::row_samples[0] = 0;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(1));
+}
+
+std::vector<int> combo_events;
+
+// Closes are logged as the scancode and opens as its negative.
+void onComboClosed(const gh::thirtytwobits::ScanCodeType (&scancodes)[10], size_t scancodes_len, void*)
+{
+    combo_events.insert(combo_events.end(), scancodes, scancodes + scancodes_len);
+}
+
+void onComboOpen(const gh::thirtytwobits::ScanCodeType (&scancodes)[10], size_t scancodes_len, void*)
+{
+    for (size_t i = 0; i < scancodes_len; ++i)
+    {
+        combo_events.push_back(-scancodes[i]);
+    }
+}
+
+TEST(SwitchMatrixScannerScriptedTest, Combos)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    using Combos          = gh::thirtytwobits::ComboDetector<2, 3, 10, FakeClock>;
+    // Reported as 7, 8 and 9.
+    constexpr Combos::Combo table[] = {Combos::combo(1, 2), Combos::combo(4, 5), Combos::combo(4, 5, 6)};
+    static_assert(table[2].keys[1] == 0x07, "Combo tables are built at compile time.");
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    Combos combos(table, 3, 1000);
+    test_subject.setup();
+    combos.setup(onComboClosed, onComboOpen);
+    FakeClock::now_us = 0;
+    combo_events.clear();
+    auto step = [&](uint32_t row0, uint32_t row1, uint32_t elapsed_us) {
+        ScriptedPins::row_samples[0] = row0;
+        ScriptedPins::row_samples[1] = row1;
+        FakeClock::now_us += elapsed_us;
+        test_subject.scan();
+        combos.update(test_subject);
+    };
+
+    // Switches outside every combo pass straight through.
+    step(0x04, 0, 0);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({3, -3}));
+
+    // A combo closes when its last switch does and opens with its first release.
+    combo_events.clear();
+    step(0x01, 0, 10);
+    ASSERT_TRUE(combo_events.empty());
+    step(0x03, 0, 500);
+    step(0x02, 0, 10);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({7, -7}));
+
+    // On its own a combo switch is reported once the window closes, or when it is released.
+    combo_events.clear();
+    step(0x02, 0, 10);
+    step(0x02, 0, 999);
+    ASSERT_TRUE(combo_events.empty());
+    step(0x02, 0, 1);
+    step(0, 0, 10);
+    step(0x01, 0, 10);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({2, -2, 1, -1}));
+
+    // 4 and 5 wait in case 6 follows.
+    combo_events.clear();
+    step(0, 0x03, 10);
+    ASSERT_TRUE(combo_events.empty());
+    step(0, 0x03, 1000);
+    ASSERT_EQ(combo_events, std::vector<int>({8}));
+    step(0, 0, 10);
+    step(0, 0x07, 10);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({8, -8, 9, -9}));
+
+    // A quick tap of 4 and 5 fires as soon as one of them is released.
+    combo_events.clear();
+    step(0, 0x01, 10);
+    step(0, 0x03, 10);
+    step(0, 0x02, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({8, -8}));
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({8, -8}));
+
+    // So does pressing a switch that isn't part of 4, 5 and 6.
+    combo_events.clear();
+    step(0, 0x03, 10);
+    step(0x04, 0x03, 10);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({8, 3, -3, -8}));
+
+    // A switch that closes just after the window ran out starts a new one instead of completing the combo.
+    combo_events.clear();
+    step(0, 0x01, 10);
+    step(0, 0x03, 1000);
+    ASSERT_EQ(combo_events, std::vector<int>({4}));
+    step(0, 0x03, 1000);
+    step(0, 0, 10);
+    ASSERT_EQ(combo_events, std::vector<int>({4, 5, -4, -5}));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, ComboTableSize)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    // Candidate sets wider than 64 combos, and a detector that only has room for the first two entries.
+    using WideCombos  = gh::thirtytwobits::ComboDetector<2, 3, 10, FakeClock, 70>;
+    using SmallCombos = gh::thirtytwobits::ComboDetector<2, 3, 10, FakeClock, 2>;
+    constexpr WideCombos::Combo  wide_table[]  = {WideCombos::combo(1, 2),
+                                                 WideCombos::combo(4, 5),
+                                                 WideCombos::combo(4, 5, 6)};
+    constexpr SmallCombos::Combo small_table[] = {SmallCombos::combo(1, 2),
+                                                  SmallCombos::combo(4, 5),
+                                                  SmallCombos::combo(4, 5, 6)};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> test_subject(
+        rows,
+        cols);
+    WideCombos  wide(wide_table, 3, 1000);
+    SmallCombos small(small_table, 3, 1000);
+    test_subject.setup();
+    FakeClock::now_us = 0;
+    std::vector<int> wide_events;
+    std::vector<int> small_events;
+    wide.setup(onComboClosed, onComboOpen);
+    small.setup(onComboClosed, onComboOpen);
+    auto step = [&](uint32_t row1, uint32_t elapsed_us) {
+        ScriptedPins::row_samples[1] = row1;
+        FakeClock::now_us += elapsed_us;
+        test_subject.scan();
+        combo_events.clear();
+        wide.update(test_subject);
+        wide_events.insert(wide_events.end(), combo_events.begin(), combo_events.end());
+        combo_events.clear();
+        small.update(test_subject);
+        small_events.insert(small_events.end(), combo_events.begin(), combo_events.end());
+    };
+
+    // Without the ignored 4, 5, 6 entry nothing bigger can follow 4 and 5.
+    step(0x01, 10);
+    step(0x03, 10);
+    ASSERT_TRUE(wide_events.empty());
+    ASSERT_EQ(small_events, std::vector<int>({8}));
+    step(0x07, 10);
+    step(0, 10);
+    ASSERT_EQ(wide_events, std::vector<int>({9, -9}));
+    ASSERT_EQ(small_events, std::vector<int>({8, 6, -8, -6}));
+}
+
+void onSwitchClosedSlowly(const gh::thirtytwobits::ScanCodeType (&)[2], size_t, void*)
+{
+    FakeClock::now_us += 5;
+}
+
+TEST(SwitchMatrixScannerScriptedTest, ScanTimingStats)
+{
+    ScriptedPins::reset();
+    FakeClock::now_us     = 0;
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2,
+                                           3,
+                                           2,
+                                           ScriptedPins,
+                                           gh::thirtytwobits::CountedDebounce<>,
+                                           gh::thirtytwobits::ScanTimingStats<FakeClock>>
+        test_subject(rows, cols, true, false);
+    test_subject.setup(onSwitchClosedSlowly);
+    ASSERT_EQ(test_subject.getStats().scans, 0U);
+    ASSERT_FALSE(test_subject.scan());
+
+    // Three closures with a two event buffer flushes once mid-scan and once at the end.
+    FakeClock::now_us += 100;
+    ScriptedPins::row_samples[1] = 0x07;
+    ASSERT_TRUE(test_subject.scan());
+    FakeClock::now_us += 50;
+    ASSERT_FALSE(test_subject.scan());
+
+    const gh::thirtytwobits::ScanStats stats = test_subject.getStats();
+    ASSERT_EQ(stats.scans, 3U);
+    ASSERT_EQ(stats.scan_min, 0U);
+    ASSERT_EQ(stats.scan_max, 10U);
+    ASSERT_EQ(stats.scan_mean, 3U);
+    ASSERT_EQ(stats.handler_total, 10U);
+    ASSERT_EQ(stats.mid_scan_flushes, 1U);
+    ASSERT_EQ(stats.period_min, 60U);
+    ASSERT_EQ(stats.period_max, 100U);
+
+    test_subject.resetStats();
+    ASSERT_EQ(test_subject.getStats().scans, 0U);
+    ASSERT_EQ(test_subject.getStats().period_min, 0U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, AdaptiveScanRate)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2,
+                                           3,
+                                           10,
+                                           ScriptedPins,
+                                           gh::thirtytwobits::CountedDebounce<>,
+                                           gh::thirtytwobits::ScanTimingStats<FakeClock>>
+        test_subject(rows, cols, true, false);
+    const gh::thirtytwobits::ScanRateStep steps[] = {{2, 2}, {4, 4}};
+    test_subject.setAdaptiveScanRate(steps, 2);
+    test_subject.setup();
+
+    // Quiet frames 1 and 2 are scanned, then every other call until frame 4, then every fourth.
+    for (size_t i = 0; i < 7; ++i)
+    {
+        ASSERT_FALSE(test_subject.scan());
+    }
+    ASSERT_EQ(ScriptedPins::select_count, 3U * 2U);
+    ASSERT_EQ(test_subject.getScanDivider(), 4U);
+    ASSERT_EQ(test_subject.getStats().skipped_scans, 4U);
+
+    // The next scan to run sees the press and restores the full rate.
+    ScriptedPins::row_samples[0] = 0x01;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_EQ(test_subject.getScanDivider(), 1U);
+    ScriptedPins::row_samples[0] = 0x00;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.scan());
+    ASSERT_EQ(ScriptedPins::select_count, 6U * 2U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, SwitchTelemetry)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[1] = {0};
+    const uint8_t cols[2] = {1, 2};
+    using Telemetry       = gh::thirtytwobits::SwitchTelemetryStats<1, 2>;
+    gh::thirtytwobits::SwitchMatrixScanner<1, 2, 10, ScriptedPins, gh::thirtytwobits::CountedDebounce<>, Telemetry>
+        test_subject(rows, cols);
+    test_subject.setup();
+    for (size_t i = 0; i < 3; ++i)
+    {
+        test_subject.scan();
+    }
+    test_subject.resetStats();
+
+    // Switch 1 chatters twice before closing on the sixth sample. Switch 2 glitches once.
+    const uint32_t samples[] = {0x3, 0x0, 0x1, 0x0, 0x1, 0x1};
+    for (const uint32_t sample : samples)
+    {
+        ScriptedPins::row_samples[0] = sample;
+        test_subject.scan();
+    }
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    const Telemetry& telemetry = test_subject.getStatsPolicy();
+    ASSERT_EQ(telemetry.getBounceCount(1), 2U);
+    ASSERT_EQ(telemetry.getBounceCount(2), 1U);
+    ASSERT_EQ(telemetry.getSettleMax(1), 6U);
+    ASSERT_EQ(telemetry.getSettleMax(2), 0U);
+    ASSERT_EQ(telemetry.getSettleHistogram()[3], 1U);
+
+    Telemetry::SwitchReport worst[2];
+    ASSERT_EQ(telemetry.getWorstSwitches(worst, 2), 2U);
+    ASSERT_EQ(worst[0].scancode, 1U);
+    ASSERT_EQ(worst[1].scancode, 2U);
+    ASSERT_EQ(telemetry.getWorstSwitches(worst, 1), 1U);
+    ASSERT_EQ(worst[0].bounces, 2U);
+}
+
+void onSwitchClosedCheckNextRow(const gh::thirtytwobits::ScanCodeType (&scancodes)[1], size_t, void*)
+{
+    // Row 0's events are reported while row 1 settles.
+    EXPECT_EQ(scancodes[0], 2U);
+    EXPECT_EQ(ScriptedPins::selected_row, 1);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, RowSettleTime)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 1, ScriptedPins> test_subject(rows, cols, true, false);
+    test_subject.setup(onSwitchClosedCheckNextRow);
+    test_subject.setRowSettleTime(20);
+    ASSERT_FALSE(test_subject.scan());
+    ScriptedPins::row_samples[0] = 0x02;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(2));
+    ASSERT_GE(ScriptedPins::min_settle, 20UL);
+    ASSERT_EQ(ScriptedPins::selected_row, -1);
+}
+
+void recordClosed(const gh::thirtytwobits::ScanCodeType (&scancodes)[10], size_t scancodes_len, void* userdata)
+{
+    std::vector<std::vector<gh::thirtytwobits::ScanCodeType>>& calls =
+        *static_cast<std::vector<std::vector<gh::thirtytwobits::ScanCodeType>>*>(userdata);
+    calls.emplace_back(scancodes, scancodes + scancodes_len);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, ScanRows)
+{
+    using gh::thirtytwobits::ScanCodeType;
+    ScriptedPins::reset();
+    const uint8_t                          rows[4] = {0, 1, 2, 3};
+    const uint8_t                          cols[2] = {4, 5};
+    std::vector<std::vector<ScanCodeType>> calls;
+    gh::thirtytwobits::SwitchMatrixScanner<4, 2, 10, ScriptedPins> test_subject(rows, cols, true, false);
+    test_subject.setup(recordClosed, nullptr, &calls);
+    ASSERT_FALSE(test_subject.scanRows(3));
+    ASSERT_EQ(ScriptedPins::select_count, 3U);
+    ASSERT_TRUE(test_subject.scanRows(3));
+    ASSERT_EQ(ScriptedPins::select_count, 4U);
+
+    // Per slice: each slice reports its own rows.
+    ScriptedPins::row_samples[0] = 0x01;
+    ScriptedPins::row_samples[3] = 0x02;
+    ASSERT_FALSE(test_subject.scanRows(2));
+    ASSERT_EQ(calls.size(), 1U);
+    ASSERT_EQ(calls[0], std::vector<ScanCodeType>({1}));
+    ASSERT_TRUE(test_subject.scanRows(2));
+    ASSERT_EQ(calls.size(), 2U);
+    ASSERT_EQ(calls[1], std::vector<ScanCodeType>({8}));
+
+    // Per frame: held until the frame completes.
+    test_subject.setSliceEventDelivery(gh::thirtytwobits::SliceEventDelivery::PER_FRAME);
+    ScriptedPins::row_samples[1] = 0x01;
+    ScriptedPins::row_samples[2] = 0x02;
+    ASSERT_FALSE(test_subject.scanRows(2));
+    ASSERT_FALSE(test_subject.scanRows(1));
+    ASSERT_EQ(calls.size(), 2U);
+    ASSERT_TRUE(test_subject.scanRows(1));
+    ASSERT_EQ(calls.size(), 3U);
+    ASSERT_EQ(calls[2], std::vector<ScanCodeType>({3, 6}));
+
+    // scan() finishes a frame that scanRows started.
+    ASSERT_FALSE(test_subject.scanRows(1));
+    ScriptedPins::select_count = 0;
+    test_subject.scan();
+    ASSERT_EQ(ScriptedPins::select_count, 3U);
+    ASSERT_FALSE(test_subject.scanRows(0));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, ScanIntoBuffer)
+{
+    ScriptedPins::reset();
+    using gh::thirtytwobits::SwitchEdge;
+    using gh::thirtytwobits::SwitchEvent;
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[3] = {2, 3, 4};
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, ScriptedPins> test_subject(rows, cols, true, false);
+    test_subject.setup();
+    SwitchEvent events[4];
+    ASSERT_EQ(test_subject.scan(events, 4), 0U);
+    ScriptedPins::row_samples[0] = 0x01;
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+
+    // A release and a press in one scan come out as one batch in scan order.
+    ScriptedPins::row_samples[0] = 0x02;
+    ScriptedPins::row_samples[1] = 0x04;
+    ASSERT_EQ(test_subject.scan(events, 4), 3U);
+    ASSERT_EQ(events[0].scancode, 1U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_EQ(events[1].scancode, 2U);
+    ASSERT_EQ(events[1].edge, SwitchEdge::CLOSED);
+    ASSERT_EQ(events[2].scancode, 6U);
+    ASSERT_EQ(events[2].edge, SwitchEdge::CLOSED);
+
+    // Whatever doesn't fit is reported by the next scan.
+    ScriptedPins::row_samples[0] = 0;
+    ScriptedPins::row_samples[1] = 0;
+    ASSERT_EQ(test_subject.scan(events, 1), 1U);
+    ASSERT_EQ(events[0].scancode, 2U);
+    ASSERT_TRUE(test_subject.isSwitchClosed(6));
+    ASSERT_EQ(test_subject.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 6U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, AntiGhost)
+{
+    ScriptedPins::reset();
+    const uint8_t rows[3] = {0, 1, 2};
+    const uint8_t cols[3] = {3, 4, 5};
+    gh::thirtytwobits::SwitchMatrixScanner<3, 3, 10, ScriptedPins> test_subject(rows, cols, true, false);
+    test_subject.setup();
+    test_subject.setAntiGhostEnabled(true);
+    ASSERT_FALSE(test_subject.scan());
+
+    // Switches 1, 2 and 5 are pressed so 4 reads closed as well. Row 1 can't be trusted.
+    ScriptedPins::row_samples[0] = 0x03;
+    ScriptedPins::row_samples[1] = 0x03;
+    ScriptedPins::row_samples[2] = 0x01;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_TRUE(test_subject.isSwitchClosed(1));
+    ASSERT_TRUE(test_subject.isSwitchClosed(2));
+    ASSERT_FALSE(test_subject.isSwitchClosed(4));
+    ASSERT_FALSE(test_subject.isSwitchClosed(5));
+    // A single shared column is not ambiguous.
+    ASSERT_TRUE(test_subject.isSwitchClosed(7));
+    ASSERT_FALSE(test_subject.scan());
+
+    // Releasing switch 1 resolves it.
+    ScriptedPins::row_samples[0] = 0x02;
+    ScriptedPins::row_samples[1] = 0x02;
+    ASSERT_TRUE(test_subject.scan());
+    ASSERT_FALSE(test_subject.isSwitchClosed(1));
+    ASSERT_FALSE(test_subject.isSwitchClosed(4));
+    ASSERT_TRUE(test_subject.isSwitchClosed(5));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, BulkQueries)
+{
+    using gh::thirtytwobits::ScanCodeType;
+    ScriptedPins::reset();
+    const uint8_t rows[3] = {0, 1, 2};
+    const uint8_t cols[3] = {3, 4, 5};
+    using Scanner         = gh::thirtytwobits::SwitchMatrixScanner<3, 3, 10, ScriptedPins>;
+    Scanner test_subject(rows, cols, true, false);
+    test_subject.setup();
+    ASSERT_EQ(test_subject.closedSwitches().begin(), test_subject.closedSwitches().end());
+
+    ScriptedPins::row_samples[0] = 0x05;
+    ScriptedPins::row_samples[2] = 0x02;
+    test_subject.scan();
+    Scanner::RowMask closed[3];
+    test_subject.getClosedBitmap(closed);
+    ASSERT_EQ(closed[0], 0x05);
+    ASSERT_EQ(closed[1], 0x00);
+    ASSERT_EQ(closed[2], 0x02);
+
+    std::vector<ScanCodeType> scancodes;
+    for (const ScanCodeType scancode : test_subject.closedSwitches())
+    {
+        scancodes.push_back(scancode);
+    }
+    ASSERT_EQ(scancodes, std::vector<ScanCodeType>({1, 3, 8}));
+}
+
+TEST(SwitchMatrixScannerScriptedTest, ScanCodeMap)
+{
+    using gh::thirtytwobits::ScanCodeType;
+    using gh::thirtytwobits::SwitchEvent;
+    ScriptedPins::reset();
+    const uint8_t rows[2] = {0, 1};
+    const uint8_t cols[2] = {2, 3};
+    using Scanner         = gh::thirtytwobits::SwitchMatrixScanner<2, 2, 10, ScriptedPins>;
+    static_assert(Scanner::scancodeOf(1, 1) == 4, "scancodeOf must be a constant expression.");
+    // The second row is numbered right to left and its first position isn't populated.
+    const ScanCodeType                   layout[4] = {10, 11, 0, 12};
+    gh::thirtytwobits::ScanCodeMap<2, 2> keymap(layout);
+    Scanner                              test_subject(rows, cols, true, false);
+    test_subject.setup();
+    ASSERT_EQ(keymap(Scanner::scancodeOf(0, 1)), 11);
+    ASSERT_EQ(keymap(5), 0);
+
+    ScriptedPins::row_samples[0] = 0x01;
+    ScriptedPins::row_samples[1] = 0x03;
+    SwitchEvent events[4];
+    ASSERT_EQ(keymap.apply(events, test_subject.scan(events, 4)), 2U);
+    ASSERT_EQ(events[0].scancode, 10);
+    ASSERT_EQ(events[1].scancode, 12);
+}
+
+namespace
+{
+/*
+ * A serial port as far as the split link is concerned.
+ */
+struct LoopbackStream
+{
+    void write(const uint8_t* data, size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    int available() const
+    {
+        return static_cast<int>(bytes.size() - read_at);
+    }
+
+    int read()
+    {
+        return bytes[read_at++];
+    }
+
+    std::vector<uint8_t> bytes;
+    size_t               read_at = 0;
+};
+}  // namespace
+
+TEST(SwitchMatrixScannerScriptedTest, SplitLink)
+{
+    using gh::thirtytwobits::SwitchEdge;
+    using gh::thirtytwobits::SwitchEvent;
+    ScriptedPins::reset();
+    const uint8_t rows[3] = {0, 1, 2};
+    const uint8_t cols[3] = {3, 4, 5};
+    gh::thirtytwobits::SwitchMatrixScanner<3, 3, 10, ScriptedPins> secondary(rows, cols, true, false);
+    gh::thirtytwobits::SplitLinkSender<3, 3>                       sender;
+    gh::thirtytwobits::SplitLinkReceiver<3, 3, 20>                 receiver;
+    LoopbackStream                                                 link;
+    secondary.setup();
+
+    // The first update sends every row.
+    secondary.scan();
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(link.bytes.size(), 3U + 3U * 2U);
+    ASSERT_FALSE(sender.update(secondary, link));
+
+    // Only the changed row is sent.
+    link.bytes.clear();
+    link.read_at                 = 0;
+    ScriptedPins::row_samples[1] = 0x05;
+    secondary.scan();
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(link.bytes, std::vector<uint8_t>({0xD5, 0x01, 0x01, 0x05, 0x07}));
+
+    SwitchEvent events[4];
+    ASSERT_EQ(receiver.poll(link, events, 1), 1U);
+    ASSERT_EQ(events[0].scancode, 24);
+    ASSERT_EQ(events[0].edge, SwitchEdge::CLOSED);
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 26);
+    ASSERT_TRUE(receiver.isSwitchClosed(24));
+    ASSERT_FALSE(receiver.isSwitchClosed(4));
+
+    // A corrupted frame is dropped and the receiver picks up the next one.
+    ScriptedPins::row_samples[1] = 0x01;
+    secondary.scan();
+    link.write(reinterpret_cast<const uint8_t*>("\xD5\x01\x02\x07\x00"), 5);
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 26);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_EQ(receiver.getBadFrameCount(), 1U);
+}
+
+TEST(SwitchMatrixScannerScriptedTest, SplitLinkRefreshAndTimeout)
+{
+    using gh::thirtytwobits::SwitchEdge;
+    using gh::thirtytwobits::SwitchEvent;
+    ScriptedPins::reset();
+    FakeClock::now_us     = 0;
+    const uint8_t rows[3] = {0, 1, 2};
+    const uint8_t cols[3] = {3, 4, 5};
+    gh::thirtytwobits::SwitchMatrixScanner<3, 3, 10, ScriptedPins, gh::thirtytwobits::NoDebounce> secondary(rows,
+                                                                                                           cols);
+    gh::thirtytwobits::SplitLinkSender<3, 3, FakeClock>        sender;
+    gh::thirtytwobits::SplitLinkReceiver<3, 3, 20, FakeClock> receiver;
+    LoopbackStream                                             link;
+    secondary.setup();
+    ScriptedPins::row_samples[2] = 0x01;
+    secondary.scan();
+    ASSERT_TRUE(sender.update(secondary, link));
+    SwitchEvent events[4];
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_TRUE(receiver.isLinkUp());
+
+    // Every row goes out again once the refresh interval has passed, even though nothing changed.
+    FakeClock::now_us = 99999;
+    ASSERT_FALSE(sender.update(secondary, link));
+    FakeClock::now_us = 100000;
+    link.bytes.clear();
+    link.read_at = 0;
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(link.bytes.size(), 3U + 3U * 2U);
+
+    // The release is lost. The next refresh still releases the switch.
+    ScriptedPins::row_samples[2] = 0;
+    secondary.scan();
+    FakeClock::now_us = 150000;
+    ASSERT_TRUE(sender.update(secondary, link));
+    link.bytes.clear();
+    link.read_at = 0;
+    ASSERT_EQ(receiver.poll(link, events, 4), 0U);
+    ASSERT_TRUE(receiver.isSwitchClosed(27));
+    FakeClock::now_us = 200000;
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 27);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+
+    // Once the link goes quiet for the timeout every remote switch is released.
+    ScriptedPins::row_samples[0] = 0x02;
+    secondary.scan();
+    ASSERT_TRUE(sender.update(secondary, link));
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_TRUE(receiver.isSwitchClosed(22));
+    FakeClock::now_us = 499999;
+    ASSERT_EQ(receiver.poll(link, events, 4), 0U);
+    FakeClock::now_us = 500000;
+    ASSERT_EQ(receiver.poll(link, events, 4), 1U);
+    ASSERT_EQ(events[0].scancode, 22);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_FALSE(receiver.isLinkUp());
+}
+
+namespace
+{
+/*
+ * Closes at most one switch per row, at any column. For matrices wider than the scripted samples.
+ */
+struct OneColumnPins
+{
+    static uint8_t closed_column[2];
+    static int     selected_row;
+
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&)[ROW_COUNT], const uint8_t (&)[COL_COUNT]) {}
+
+        void setup(uint8_t) {}
+
+        void selectRow(size_t row)
+        {
+            selected_row = static_cast<int>(row);
+        }
+
+        void releaseRow(size_t)
+        {
+            selected_row = -1;
+        }
+
+        void selectAllRows() {}
+
+        void releaseAllRows() {}
+
+        RowMask readColumns() const
+        {
+            const uint8_t column = closed_column[selected_row];
+            return (column < COL_COUNT) ? gh::thirtytwobits::column_bit<RowMask>(column) : RowMask(0);
+        }
+
+        bool armWake(void (*)())
+        {
+            return false;
+        }
+
+        void disarmWake() {}
+    };
+};
+
+uint8_t OneColumnPins::closed_column[2] = {0xFF, 0xFF};
+int     OneColumnPins::selected_row     = -1;
+}  // namespace
+
+TEST(SwitchMatrixScannerScriptedTest, WideRows)
+{
+    using gh::thirtytwobits::SwitchEdge;
+    using gh::thirtytwobits::SwitchEvent;
+    uint8_t rows[2] = {0, 1};
+    uint8_t cols[70];
+    for (uint8_t c = 0; c < 70; ++c)
+    {
+        cols[c] = c;
+    }
+    using Scanner = gh::thirtytwobits::SwitchMatrixScanner<2, 70, 10, OneColumnPins>;
+    static_assert(sizeof(Scanner::RowMask) == 12, "70 columns need three words.");
+    Scanner                                        test_subject(rows, cols, true, false);
+    gh::thirtytwobits::SplitLinkSender<2, 70>      sender;
+    gh::thirtytwobits::SplitLinkReceiver<2, 70, 0> receiver;
+    LoopbackStream                                 link;
+    test_subject.setup();
+
+    OneColumnPins::closed_column[0] = 33;
+    OneColumnPins::closed_column[1] = 69;
+    SwitchEvent events[4];
+    ASSERT_EQ(test_subject.scan(events, 4), 2U);
+    ASSERT_EQ(events[0].scancode, 34);
+    ASSERT_EQ(events[1].scancode, 140);
+    ASSERT_TRUE(test_subject.isSwitchClosed(140));
+    ASSERT_FALSE(test_subject.isSwitchClosed(70));
+
+    ASSERT_TRUE(sender.update(test_subject, link));
+    ASSERT_EQ(link.bytes.size(), 3U + 2U * 13U);
+    ASSERT_EQ(receiver.poll(link, events, 4), 2U);
+    ASSERT_EQ(events[1].scancode, 140);
+    ASSERT_EQ(events[1].edge, SwitchEdge::CLOSED);
+}
+
+namespace
+{
+/*
+ * Scripted pins with separate state for each matrix of a group. Row drives and reads are logged, tagged with
+ * ID, into one shared log.
+ */
+std::string group_pin_log;
+
+template <size_t ID>
+struct GroupPins
+{
+    static uint8_t row_samples[3];
+
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&)[ROW_COUNT], const uint8_t (&)[COL_COUNT])
+            : m_selected(-1)
+        {}
+
+        void setup(uint8_t) {}
+
+        void selectRow(size_t row)
+        {
+            EXPECT_EQ(m_selected, -1);
+            m_selected = static_cast<int>(row);
+            group_pin_log += "s" + std::to_string(ID) + "." + std::to_string(row) + " ";
+        }
+
+        void releaseRow(size_t row)
+        {
+            EXPECT_EQ(m_selected, static_cast<int>(row));
+            m_selected = -1;
+        }
+
+        void selectAllRows() {}
+
+        void releaseAllRows() {}
+
+        RowMask readColumns() const
+        {
+            group_pin_log += "r" + std::to_string(ID) + " ";
+            return static_cast<RowMask>(row_samples[m_selected]);
+        }
+
+        bool armWake(void (*)())
+        {
+            return false;
+        }
+
+        void disarmWake() {}
+
+    private:
+        int m_selected;
+    };
+};
+
+template <size_t ID>
+uint8_t GroupPins<ID>::row_samples[3] = {0};
+}  // namespace
+
+TEST(SwitchMatrixScannerScriptedTest, ScanGroup)
+{
+    using gh::thirtytwobits::GroupSwitchEvent;
+    using gh::thirtytwobits::NoDebounce;
+    using gh::thirtytwobits::SwitchEdge;
+    const uint8_t key_rows[2]    = {0, 1};
+    const uint8_t key_cols[2]    = {2, 3};
+    const uint8_t button_rows[3] = {4, 5, 6};
+    const uint8_t button_cols[1] = {7};
+    using Keys                   = gh::thirtytwobits::SwitchMatrixScanner<2, 2, 10, GroupPins<0>, NoDebounce>;
+    using Buttons                = gh::thirtytwobits::SwitchMatrixScanner<3, 1, 10, GroupPins<1>, NoDebounce>;
+    Keys                                                    keys(key_rows, key_cols);
+    Buttons                                                 buttons(button_rows, button_cols);
+    gh::thirtytwobits::SwitchMatrixScanGroup<Keys, Buttons> group(keys, buttons);
+    keys.setup();
+    buttons.setup();
+
+    GroupPins<0>::row_samples[1] = 0x02;
+    GroupPins<1>::row_samples[2] = 0x01;
+    group_pin_log.clear();
+    GroupSwitchEvent events[4];
+    ASSERT_EQ(group.scan(events, 4), 2U);
+    // Each matrix's next row is driven while the other matrix is read.
+    ASSERT_EQ(group_pin_log, "s0.0 r0 s0.1 s1.0 r1 s1.1 r0 r1 s1.2 r1 ");
+    ASSERT_EQ(events[0].matrix, 0U);
+    ASSERT_EQ(events[0].scancode, 4);
+    ASSERT_EQ(events[0].edge, SwitchEdge::CLOSED);
+    ASSERT_EQ(events[1].matrix, 1U);
+    ASSERT_EQ(events[1].scancode, 3);
+    ASSERT_TRUE(buttons.isSwitchClosed(3));
+
+    // The buttons are only scanned every other call.
+    group.setScanDivider(1, 2);
+    GroupPins<1>::row_samples[2] = 0;
+    group_pin_log.clear();
+    ASSERT_EQ(group.scan(events, 4), 1U);
+    ASSERT_EQ(events[0].matrix, 1U);
+    ASSERT_EQ(events[0].edge, SwitchEdge::OPENED);
+    ASSERT_EQ(group.scan(events, 4), 0U);
+    ASSERT_EQ(group_pin_log, "s0.0 r0 s0.1 s1.0 r1 s1.1 r0 r1 s1.2 r1 s0.0 r0 s0.1 r0 ");
+}
+
+// +--------------------------------------------------------------------------+
+// | BUS BACKENDS
+// +--------------------------------------------------------------------------+
+FakeSPIClass SPI;
+FakeTwoWire  Wire;
+
+TEST(SwitchMatrixBusTest, ShiftRegisterRows)
+{
+    using ::testing::Invoke;
+    // Two registers with the rows on the second one, plus a row past the end of the chain.
+    using Rows                   = gh::thirtytwobits::ShiftRegisterRows<20, 2>;
+    const uint8_t row_outputs[5] = {8, 9, 10, 11, 16};
+    mock_state.reset(new ::testing::NiceMock<MockArduinoState>());
+    // Latch edges go into the SPI log so they can be checked against the transfers.
+    ON_CALL(*mock_state, digitalWrite(20, _)).WillByDefault(Invoke([](int, int level) {
+        SPI.log += (level == LOW) ? "L " : "H ";
+    }));
+    EXPECT_CALL(*mock_state, pinMode(20, OUTPUT));
+    Rows::Driver<5> test_subject(row_outputs);
+    SPI.log.clear();
+    test_subject.setup();
+    // The byte for the register furthest from the MCU goes first. The latch is only raised once both are in.
+    ASSERT_EQ(SPI.log, "H [ L FF FF H ] ");
+
+    SPI.log.clear();
+    test_subject.selectRow(1);
+    ASSERT_EQ(SPI.log, "[ L FD FF H ] ");
+    SPI.log.clear();
+    test_subject.releaseRow(1);
+    test_subject.selectRow(3);
+    ASSERT_EQ(SPI.log, "[ L FF FF H ] [ L F7 FF H ] ");
+
+    // Nothing past the end of the chain is written.
+    SPI.log.clear();
+    test_subject.releaseRow(3);
+    test_subject.selectRow(4);
+    ASSERT_EQ(SPI.log, "[ L FF FF H ] [ L FF FF H ] ");
+
+    // Moving from one row to the next is a single write.
+    SPI.log.clear();
+    test_subject.selectRow(0);
+    SPI.log.clear();
+    test_subject.advanceRow(0, 2);
+    ASSERT_EQ(SPI.log, "[ L FB FF H ] ");
+    test_subject.releaseRow(2);
+
+    SPI.log.clear();
+    test_subject.selectAllRows();
+    ASSERT_EQ(SPI.log, "[ L 00 00 H ] ");
+    mock_state.reset();
+}
+
+TEST(SwitchMatrixBusTest, ShiftRegisterRowsScanOneWritePerRow)
+{
+    using Pins = gh::thirtytwobits::SplitPins<gh::thirtytwobits::ShiftRegisterRows<20, 1>,
+                                              gh::thirtytwobits::ArduinoColumns>;
+    const uint8_t row_outputs[3] = {0, 1, 2};
+    const uint8_t cols[2]        = {3, 4};
+    mock_state.reset(new ::testing::NiceMock<MockArduinoState>());
+    ON_CALL(*mock_state, digitalRead(_)).WillByDefault(Return(HIGH));
+    gh::thirtytwobits::SwitchMatrixScanner<3, 2, 10, Pins> test_subject(row_outputs, cols);
+    test_subject.setup();
+    SPI.log.clear();
+    test_subject.scan();
+    // Select row 0, two moves to the next row and release row 2 at the end of the frame.
+    ASSERT_EQ(SPI.log, "[ FE ] [ FD ] [ FB ] [ FF ] ");
+    mock_state.reset();
+}
+
+TEST(SwitchMatrixBusTest, Mcp23017ColumnsPortA)
+{
+    using Columns                = gh::thirtytwobits::Mcp23017Columns<0x21>;
+    const uint8_t column_pins[3] = {0, 1, 2};
+    Columns::Reader<3, uint8_t> test_subject(column_pins);
+    // IODIR is left alone. GPPUA/B are read and written back with only the column bits changed, each pair in
+    // one auto-incrementing transfer.
+    Wire.log.clear();
+    Wire.responses.assign({0x80, 0x01});
+    test_subject.setup(INPUT_PULLUP);
+    ASSERT_EQ(Wire.log, "S21 W0C R Q21,2 S21 W0C W87 W01 P ");
+
+    Wire.log.clear();
+    Wire.responses.assign({0x87, 0x01});
+    test_subject.setup(INPUT);
+    ASSERT_EQ(Wire.log, "S21 W0C R Q21,2 S21 W0C W80 W01 P ");
+
+    // Only GPIOA is read when every column is on port A. Pressed switches read LOW.
+    Wire.log.clear();
+    Wire.responses.assign({0xFA});
+    ASSERT_EQ(test_subject.readColumns(), 0x05);
+    ASSERT_EQ(Wire.log, "S21 W12 R Q21,1 ");
+}
+
+TEST(SwitchMatrixBusTest, Mcp23017ColumnsBothPorts)
+{
+    using Columns = gh::thirtytwobits::Mcp23017Columns<>;
+    // Columns 0 and 2 are on GPB1 and GPA3.
+    const uint8_t column_pins[3] = {9, 0, 3};
+    Columns::Reader<3, uint8_t> test_subject(column_pins);
+    Wire.log.clear();
+    Wire.responses.assign({0x00, 0x00});
+    test_subject.setup(INPUT_PULLUP);
+    ASSERT_EQ(Wire.log, "S20 W0C R Q20,2 S20 W0C W09 W02 P ");
+
+    Wire.log.clear();
+    Wire.responses.assign({0xF7, 0xFD});
+    ASSERT_EQ(test_subject.readColumns(), 0x05);
+    ASSERT_EQ(Wire.log, "S20 W12 R Q20,2 ");
+    Wire.responses.assign({0xFE, 0xFF});
+    ASSERT_EQ(test_subject.readColumns(), 0x02);
+    ASSERT_TRUE(Wire.responses.empty());
+}
@@ -0,0 +1,657 @@
+/*
+    MIT License
+
+    Copyright (c) 2021 Scott A Dixon
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef GH_THIRTYTWOBITS_SWITCH_MATRIX_TRACE_REPLAY_H
+#define GH_THIRTYTWOBITS_SWITCH_MATRIX_TRACE_REPLAY_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "SwitchMatrixScanner.h"
+
+/**
+ * Recorded raw matrix samples and a host-side driver that replays them through a scanner. A trace is:
+ *
+ *      +------+---------+-----------+------------+----------+-----+
+ *      | SMTR | version | row count | mask bytes | reserved | frames ...
+ *      +------+---------+-----------+------------+----------+-----+
+ *
+ * followed by frames of:
+ *
+ *      +----------------+-------+-----------+---------------+-----+
+ *      | delta us (LEB) | count | row index | row mask (LE) | ... |
+ *      +----------------+-------+-----------+---------------+-----+
+ *                               |<-- count times, changed rows -->|
+ *
+ * The delta is the time since the previous frame (since 0 for the first) as an unsigned LEB128 varint and a
+ * row mask is the raw sample of that row with a bit set for each closed switch. Rows that didn't change since
+ * the previous frame are left out, so a frame where nothing changed is two bytes. The row records are the
+ * same as the split link's so the secondary half of a split keyboard can be captured with a serial logger.
+ *
+ * The replay feeds each frame to the scanner through TracePins and TraceClock and compares the events it
+ * reports against reference edges found in the raw samples. A reference edge is a switch whose raw state
+ * changed and then held for stable_us; its time is the first change of the burst, before any bounce. Each
+ * reference edge is matched with the first reported edge of the same direction before the switch's next
+ * reference edge. Reference edges without one are missed and every other reported edge is a duplicate.
+ *
+ * Example:
+ *
+ *      using Scanner = gh::thirtytwobits::SwitchMatrixScanner<8, 16, 10, gh::thirtytwobits::TracePins>;
+ *      Scanner scanner(rows, cols);
+ *      scanner.setup();
+ *      const gh::thirtytwobits::TraceReplayReport report = gh::thirtytwobits::replay_trace(scanner, trace, len);
+ */
+namespace gh
+{
+namespace thirtytwobits
+{
+namespace
+{
+constexpr uint8_t TraceMagic[4]  = {'S', 'M', 'T', 'R'};
+constexpr uint8_t TraceVersion   = 1;
+constexpr size_t  TraceHeaderLen = 8;
+};  // namespace
+
+// +--------------------------------------------------------------------------+
+// | TRACE FORMAT
+// +--------------------------------------------------------------------------+
+/**
+ * Writes a trace one frame at a time. STREAM is anything with `write(const uint8_t*, size_t)`. Only the rows
+ * that changed are written so it can be called for every scan.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT>
+class TraceWriter final
+{
+public:
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+
+    static_assert(ROW_COUNT <= 255, "Row indices are stored as one byte.");
+
+    TraceWriter()
+        : m_last()
+        , m_last_us(0)
+        , m_started(false)
+    {}
+
+    TraceWriter(const TraceWriter&)  = delete;
+    TraceWriter(const TraceWriter&&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&&) = delete;
+
+    /**
+     * Appends the raw samples of every row at timestamp_us. Timestamps must not go backwards; the first frame
+     * also writes the header and every row that isn't all open.
+     */
+    template <typename STREAM>
+    void frame(STREAM& stream, const uint64_t timestamp_us, const RowMask (&rows)[ROW_COUNT])
+    {
+        if (!m_started)
+        {
+            const uint8_t header[TraceHeaderLen] = {TraceMagic[0],
+                                                    TraceMagic[1],
+                                                    TraceMagic[2],
+                                                    TraceMagic[3],
+                                                    TraceVersion,
+                                                    static_cast<uint8_t>(ROW_COUNT),
+                                                    static_cast<uint8_t>(sizeof(RowMask)),
+                                                    0};
+            stream.write(header, sizeof(header));
+            m_started = true;
+        }
+        uint8_t  frame[MaxFrameSize];
+        size_t   frame_len = 0;
+        uint64_t delta     = timestamp_us - m_last_us;
+        m_last_us          = timestamp_us;
+        do
+        {
+            const uint8_t low  = static_cast<uint8_t>(delta & 0x7F);
+            delta              = delta >> 7;
+            frame[frame_len++] = static_cast<uint8_t>((delta != 0) ? (low | 0x80) : low);
+        } while (delta != 0);
+        const size_t count_at = frame_len++;
+        uint8_t      count    = 0;
+        for (size_t r = 0; r < ROW_COUNT; ++r)
+        {
+            if (rows[r] == m_last[r])
+            {
+                continue;
+            }
+            m_last[r]          = rows[r];
+            frame[frame_len++] = static_cast<uint8_t>(r);
+            for (size_t b = 0; b < sizeof(RowMask); ++b)
+            {
+                frame[frame_len++] = row_mask_byte(rows[r], b);
+            }
+            ++count;
+        }
+        frame[count_at] = count;
+        stream.write(frame, frame_len);
+    }
+
+private:
+    // Ten bytes is enough for any 64-bit varint.
+    static constexpr const size_t MaxFrameSize = 10 + 1 + ROW_COUNT * (1 + sizeof(RowMask));
+
+    RowMask  m_last[ROW_COUNT];
+    uint64_t m_last_us;
+    bool     m_started;
+};
+
+/**
+ * Reads a trace from memory. The buffer must outlive the reader.
+ */
+class TraceReader final
+{
+public:
+    struct Frame
+    {
+        uint64_t       timestamp_us;
+        // count records of a row index followed by maskBytes() bytes.
+        uint8_t        count;
+        const uint8_t* records;
+    };
+
+    TraceReader(const uint8_t* const data, const size_t data_len)
+        : m_data(data)
+        , m_data_len(data_len)
+        , m_at(TraceHeaderLen)
+        , m_now_us(0)
+        , m_valid(data_len >= TraceHeaderLen && memcmp(data, TraceMagic, sizeof(TraceMagic)) == 0 &&
+                  data[4] == TraceVersion)
+    {}
+
+    /**
+     * False if the buffer doesn't start with a trace header of a version this reader understands.
+     */
+    bool valid() const
+    {
+        return m_valid;
+    }
+
+    uint8_t rowCount() const
+    {
+        return m_valid ? m_data[5] : 0;
+    }
+
+    uint8_t maskBytes() const
+    {
+        return m_valid ? m_data[6] : 0;
+    }
+
+    /**
+     * Reads the next frame. Returns false at the end of the trace or if the rest of it is truncated.
+     */
+    bool next(Frame& frame)
+    {
+        if (!m_valid)
+        {
+            return false;
+        }
+        uint64_t delta = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            if (m_at >= m_data_len || shift > 63)
+            {
+                return false;
+            }
+            const uint8_t byte = m_data[m_at++];
+            delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        if (m_at >= m_data_len)
+        {
+            return false;
+        }
+        const uint8_t count   = m_data[m_at++];
+        const size_t  records = static_cast<size_t>(count) * (1 + maskBytes());
+        if (m_data_len - m_at < records)
+        {
+            return false;
+        }
+        m_now_us += delta;
+        frame = Frame{m_now_us, count, m_data + m_at};
+        m_at += records;
+        return true;
+    }
+
+    /**
+     * Starts again from the first frame.
+     */
+    void rewind()
+    {
+        m_at     = TraceHeaderLen;
+        m_now_us = 0;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t         m_data_len;
+    size_t         m_at;
+    uint64_t       m_now_us;
+    bool           m_valid;
+};
+
+/**
+ * Collects a trace in memory.
+ */
+struct TraceBuffer
+{
+    void write(const uint8_t* const data, const size_t data_len)
+    {
+        bytes.insert(bytes.end(), data, data + data_len);
+    }
+
+    std::vector<uint8_t> bytes;
+};
+
+// +--------------------------------------------------------------------------+
+// | REPLAY POLICIES
+// +--------------------------------------------------------------------------+
+/**
+ * Pin access policy that reads the rows of the frame being replayed.
+ */
+struct TracePins
+{
+    /*
+     * The replay's RowMask array. Set by replay_trace.
+     */
+    static const void*& rows()
+    {
+        static const void* rows = nullptr;
+        return rows;
+    }
+
+    template <size_t ROW_COUNT, size_t COL_COUNT, typename RowMask>
+    class Driver
+    {
+    public:
+        Driver(const uint8_t (&)[ROW_COUNT], const uint8_t (&)[COL_COUNT])
+            : m_selected(0)
+            , m_all(false)
+        {}
+
+        void setup(uint8_t) {}
+
+        void selectRow(const size_t row)
+        {
+            m_selected = row;
+            m_all      = false;
+        }
+
+        void releaseRow(size_t) {}
+
+        void selectAllRows()
+        {
+            m_all = true;
+        }
+
+        void releaseAllRows()
+        {
+            m_all = false;
+        }
+
+        RowMask readColumns() const
+        {
+            const RowMask* const samples = static_cast<const RowMask*>(rows());
+            if (!m_all)
+            {
+                return samples[m_selected];
+            }
+            RowMask any_row = 0;
+            for (size_t r = 0; r < ROW_COUNT; ++r)
+            {
+                any_row |= samples[r];
+            }
+            return any_row;
+        }
+
+        bool armWake(void (*)())
+        {
+            return false;
+        }
+
+        void disarmWake() {}
+
+    private:
+        size_t m_selected;
+        bool   m_all;
+    };
+};
+
+/**
+ * Clock policy for TimedDebounce and ScanTimingStats that follows the replayed timestamps.
+ */
+struct TraceClock
+{
+    static uint64_t& nowUs()
+    {
+        static uint64_t now_us = 0;
+        return now_us;
+    }
+
+    static void begin() {}
+
+    static uint32_t now()
+    {
+        return static_cast<uint32_t>(nowUs());
+    }
+};
+
+// +--------------------------------------------------------------------------+
+// | REPLAY
+// +--------------------------------------------------------------------------+
+struct TraceReplayOptions
+{
+    // Scan at this period using the latest frame, or once per frame if 0.
+    uint32_t scan_period_us;
+    // How long a raw change must hold to count as a reference edge.
+    uint32_t stable_us;
+};
+
+struct TraceReplayReport
+{
+    // False if the trace is unreadable or doesn't match the scanner's dimensions.
+    bool     valid;
+    uint64_t frames;
+    uint64_t scans;
+    uint64_t reference_edges;
+    uint64_t reported_edges;
+    uint64_t missed;
+    uint64_t duplicates;
+    // From the first raw change of a reference edge to the scan that reported it.
+    uint32_t latency_p50_us;
+    uint32_t latency_p99_us;
+    uint32_t latency_max_us;
+    // Host time spent replaying, for throughput.
+    double seconds;
+
+    double framesPerSecond() const
+    {
+        return (seconds > 0) ? static_cast<double>(frames) / seconds : 0;
+    }
+};
+
+namespace
+{
+struct TraceEdge
+{
+    uint64_t   timestamp_us;
+    SwitchEdge edge;
+};
+
+/*
+ * Adds the matches of one switch's reported edges against its reference edges to the report.
+ */
+inline void match_trace_edges(const std::vector<TraceEdge>& reference,
+                              const std::vector<TraceEdge>& reported,
+                              TraceReplayReport&            report,
+                              std::vector<uint32_t>&        latencies)
+{
+    size_t e = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        const uint64_t window_end = (i + 1 < reference.size()) ? reference[i + 1].timestamp_us : ~0ULL;
+        bool           matched    = false;
+        for (; e < reported.size() && reported[e].timestamp_us < window_end; ++e)
+        {
+            if (!matched && reported[e].edge == reference[i].edge &&
+                reported[e].timestamp_us >= reference[i].timestamp_us)
+            {
+                matched = true;
+                latencies.push_back(static_cast<uint32_t>(reported[e].timestamp_us - reference[i].timestamp_us));
+            }
+            else
+            {
+                ++report.duplicates;
+            }
+        }
+        report.missed += matched ? 0 : 1;
+    }
+    report.duplicates += reported.size() - e;
+}
+};  // namespace
+
+/**
+ * Replays a trace through scanner, which must use TracePins (and TraceClock for any clock policy) and have
+ * had setup() called. The scanner's state carries over between calls.
+ */
+template <typename SCANNER>
+TraceReplayReport replay_trace(SCANNER&                  scanner,
+                               const uint8_t* const      trace,
+                               const size_t              trace_len,
+                               const TraceReplayOptions& options = TraceReplayOptions{0, 5000})
+{
+    using RowMask                = typename SCANNER::RowMask;
+    constexpr size_t ROW_COUNT   = SCANNER::row_count;
+    constexpr size_t COL_COUNT   = SCANNER::col_count;
+    constexpr size_t SwitchCount = ROW_COUNT * COL_COUNT;
+
+    TraceReplayReport report = TraceReplayReport();
+    TraceReader       reader(trace, trace_len);
+    if (reader.rowCount() != ROW_COUNT || reader.maskBytes() != sizeof(RowMask))
+    {
+        return report;
+    }
+    report.valid = true;
+
+    // Per switch raw state tracking for the reference edges.
+    struct Reference
+    {
+        uint64_t burst_start_us;
+        uint64_t last_change_us;
+        bool     stable;
+        bool     pending;
+    };
+    RowMask                             raw[ROW_COUNT] = {};
+    std::vector<Reference>              switches(SwitchCount, Reference());
+    std::vector<size_t>                 pending;
+    std::vector<std::vector<TraceEdge>> reference(SwitchCount);
+    std::vector<std::vector<TraceEdge>> reported(SwitchCount);
+    std::vector<SwitchEvent>            events(SwitchCount);
+    TracePins::rows() = raw;
+
+    auto settle = [&](const uint64_t now_us) {
+        size_t kept = 0;
+        for (const size_t s : pending)
+        {
+            Reference& ref = switches[s];
+            if (now_us - ref.last_change_us < options.stable_us)
+            {
+                pending[kept++] = s;
+                continue;
+            }
+            ref.pending      = false;
+            const bool state = ((raw[s / COL_COUNT] & column_bit<RowMask>(s % COL_COUNT)) != 0);
+            if (state != ref.stable)
+            {
+                ref.stable = state;
+                reference[s].push_back(TraceEdge{ref.burst_start_us, state ? SwitchEdge::CLOSED : SwitchEdge::OPENED});
+                ++report.reference_edges;
+            }
+        }
+        pending.resize(kept);
+    };
+    auto scan_at = [&](const uint64_t now_us) {
+        TraceClock::nowUs() = now_us;
+        const size_t events_len = scanner.scan(events.data(), events.size());
+        for (size_t i = 0; i < events_len; ++i)
+        {
+            reported[events[i].scancode - 1].push_back(TraceEdge{now_us, events[i].edge});
+        }
+        report.reported_edges += events_len;
+        ++report.scans;
+    };
+
+    const auto         started   = std::chrono::steady_clock::now();
+    uint64_t           next_scan = 0;
+    uint64_t           now_us    = 0;
+    TraceReader::Frame frame;
+    while (reader.next(frame))
+    {
+        if (options.scan_period_us > 0)
+        {
+            next_scan = (report.frames == 0) ? frame.timestamp_us : next_scan;
+            for (; next_scan < frame.timestamp_us; next_scan += options.scan_period_us)
+            {
+                scan_at(next_scan);
+            }
+        }
+        now_us = frame.timestamp_us;
+        for (size_t i = 0; i < frame.count; ++i)
+        {
+            const uint8_t* const record = frame.records + i * (1 + sizeof(RowMask));
+            const size_t         r      = record[0];
+            if (r >= ROW_COUNT)
+            {
+                continue;
+            }
+            RowMask mask = 0;
+            for (size_t b = 0; b < sizeof(RowMask); ++b)
+            {
+                set_row_mask_byte(mask, b, record[1 + b]);
+            }
+            mask            = static_cast<RowMask>(mask & column_mask<RowMask>(COL_COUNT));
+            RowMask changed = static_cast<RowMask>(mask ^ raw[r]);
+            raw[r]          = mask;
+            for (; changed != 0; changed = clear_lowest_column(changed))
+            {
+                const size_t s   = r * COL_COUNT + lowest_column(changed);
+                Reference&   ref = switches[s];
+                if (!ref.pending)
+                {
+                    ref.pending        = true;
+                    ref.burst_start_us = now_us;
+                    pending.push_back(s);
+                }
+                ref.last_change_us = now_us;
+            }
+        }
+        settle(now_us);
+        if (options.scan_period_us == 0)
+        {
+            scan_at(now_us);
+        }
+        ++report.frames;
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::vector<uint32_t> latencies;
+    for (size_t s = 0; s < SwitchCount; ++s)
+    {
+        match_trace_edges(reference[s], reported[s], report, latencies);
+    }
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        report.latency_p50_us = latencies[(latencies.size() - 1) * 50 / 100];
+        report.latency_p99_us = latencies[(latencies.size() - 1) * 99 / 100];
+        report.latency_max_us = latencies.back();
+    }
+    return report;
+}
+
+// +--------------------------------------------------------------------------+
+// | SYNTHETIC TRACES
+// +--------------------------------------------------------------------------+
+struct SyntheticTraceOptions
+{
+    uint32_t frames;
+    uint32_t frame_period_us;
+    // Time from one press to the next, on a random switch.
+    uint32_t press_interval_us;
+    uint32_t hold_us;
+    // After each press and release the contact chatters at random for up to this long.
+    uint32_t bounce_us;
+    uint32_t seed;
+};
+
+/**
+ * Writes a trace of random presses with contact bounce, for tests and benchmarks when no capture is at hand.
+ */
+template <size_t ROW_COUNT, size_t COL_COUNT, typename STREAM>
+void synthesize_trace(STREAM& stream, const SyntheticTraceOptions& options)
+{
+    using RowMask = typename RowMaskTraits<COL_COUNT>::type;
+    struct Press
+    {
+        size_t   row;
+        size_t   column;
+        uint64_t pressed_at;
+        uint64_t released_at;
+        uint32_t press_bounce;
+        uint32_t release_bounce;
+    };
+    uint32_t lcg  = options.seed;
+    auto     rand = [&lcg]() {
+        lcg = lcg * 1664525U + 1013904223U;
+        return lcg >> 8;
+    };
+    TraceWriter<ROW_COUNT, COL_COUNT> writer;
+    std::vector<Press>                held;
+    uint64_t                          next_press = 0;
+    for (uint32_t f = 0; f < options.frames; ++f)
+    {
+        const uint64_t now_us = static_cast<uint64_t>(f) * options.frame_period_us;
+        if (now_us >= next_press)
+        {
+            const uint32_t bounce = (options.bounce_us > 0) ? options.bounce_us : 1;
+            held.push_back(Press{rand() % ROW_COUNT,
+                                 rand() % COL_COUNT,
+                                 now_us,
+                                 now_us + options.hold_us,
+                                 rand() % bounce,
+                                 rand() % bounce});
+            next_press += options.press_interval_us;
+        }
+        RowMask rows[ROW_COUNT] = {};
+        size_t  kept            = 0;
+        for (const Press& press : held)
+        {
+            bool closed = (now_us < press.released_at);
+            if (now_us - press.pressed_at < press.press_bounce ||
+                (now_us >= press.released_at && now_us - press.released_at < press.release_bounce))
+            {
+                closed = ((rand() & 1) != 0);
+            }
+            if (closed)
+            {
+                rows[press.row] |= column_bit<RowMask>(press.column);
+            }
+            if (now_us < press.released_at + press.release_bounce)
+            {
+                held[kept++] = press;
+            }
+        }
+        held.resize(kept);
+        writer.frame(stream, now_us, rows);
+    }
+}
+
+};  // namespace thirtytwobits
+};  // namespace gh
+
+#endif  // GH_THIRTYTWOBITS_SWITCH_MATRIX_TRACE_REPLAY_H
@@ -0,0 +1,154 @@
+#include "gmock/gmock.h"
+
+#define INPUT 1
+#define INPUT_PULLUP 2
+#define OUTPUT 3
+#define LOW 4
+#define HIGH 5
+
+void digitalWrite(int pin, int level);
+
+int digitalRead(int pin);
+
+void pinMode(int pin, int mode);
+
+unsigned long micros();
+
+#include "SwitchMatrixTraceReplay.h"
+
+using gh::thirtytwobits::TraceBuffer;
+using gh::thirtytwobits::TracePins;
+using gh::thirtytwobits::TraceReader;
+using gh::thirtytwobits::TraceReplayReport;
+using gh::thirtytwobits::TraceWriter;
+
+namespace
+{
+const uint8_t rows[2] = {0, 1};
+const uint8_t cols[3] = {2, 3, 4};
+
+/*
+ * One press of switch 5 that bounces for 300us on the way down and 200us on the way up, sampled every 100us.
+ */
+void write_bouncy_press(TraceBuffer& trace)
+{
+    TraceWriter<2, 3> writer;
+    uint8_t           samples[2] = {0, 0};
+    const uint8_t     bounce[]   = {1, 0, 1, 1, 0, 1};
+    uint64_t          now_us     = 0;
+    for (; now_us < 1000; now_us += 100)
+    {
+        writer.frame(trace, now_us, samples);
+    }
+    for (const uint8_t closed : bounce)
+    {
+        samples[1] = static_cast<uint8_t>(closed << 1);
+        writer.frame(trace, now_us, samples);
+        now_us += 50;
+    }
+    for (; now_us < 30000; now_us += 100)
+    {
+        samples[1] = (now_us < 20000 || now_us == 20100) ? 0x02 : 0;
+        writer.frame(trace, now_us, samples);
+    }
+}
+}  // namespace
+
+TEST(SwitchMatrixTraceReplayTest, Format)
+{
+    TraceBuffer       trace;
+    TraceWriter<2, 3> writer;
+    uint8_t           samples[2] = {0, 0x05};
+    writer.frame(trace, 0, samples);
+    writer.frame(trace, 200, samples);
+    samples[0] = 0x02;
+    writer.frame(trace, 200, samples);
+    ASSERT_EQ(trace.bytes,
+              std::vector<uint8_t>({'S', 'M', 'T', 'R', 1, 2, 1, 0, 0x00, 0x01, 0x01, 0x05, 0xC8, 0x01, 0x00, 0x00,
+                                    0x01, 0x00, 0x02}));
+
+    TraceReader reader(trace.bytes.data(), trace.bytes.size());
+    ASSERT_TRUE(reader.valid());
+    ASSERT_EQ(reader.rowCount(), 2U);
+    ASSERT_EQ(reader.maskBytes(), 1U);
+    TraceReader::Frame frame;
+    ASSERT_TRUE(reader.next(frame));
+    ASSERT_EQ(frame.count, 1U);
+    ASSERT_EQ(frame.records[0], 1U);
+    ASSERT_TRUE(reader.next(frame));
+    ASSERT_EQ(frame.timestamp_us, 200U);
+    ASSERT_EQ(frame.count, 0U);
+    ASSERT_TRUE(reader.next(frame));
+    ASSERT_EQ(frame.timestamp_us, 200U);
+    ASSERT_FALSE(reader.next(frame));
+
+    // A truncated frame ends the trace.
+    TraceReader truncated(trace.bytes.data(), trace.bytes.size() - 1);
+    ASSERT_TRUE(truncated.next(frame));
+    ASSERT_TRUE(truncated.next(frame));
+    ASSERT_FALSE(truncated.next(frame));
+}
+
+TEST(SwitchMatrixTraceReplayTest, Replay)
+{
+    TraceBuffer trace;
+    write_bouncy_press(trace);
+
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, TracePins> debounced(rows, cols);
+    debounced.setup();
+    const TraceReplayReport report = replay_trace(debounced, trace.bytes.data(), trace.bytes.size());
+    ASSERT_TRUE(report.valid);
+    ASSERT_EQ(report.frames, 303U);
+    ASSERT_EQ(report.scans, report.frames);
+    ASSERT_EQ(report.reference_edges, 2U);
+    ASSERT_EQ(report.reported_edges, 2U);
+    ASSERT_EQ(report.missed, 0U);
+    ASSERT_EQ(report.duplicates, 0U);
+    ASSERT_GT(report.latency_p50_us, 0U);
+    ASSERT_LE(report.latency_max_us, 2000U);
+
+    // Without debouncing every bounce is reported.
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, TracePins, gh::thirtytwobits::NoDebounce> raw(rows, cols);
+    raw.setup();
+    const TraceReplayReport bouncing = replay_trace(raw, trace.bytes.data(), trace.bytes.size());
+    ASSERT_EQ(bouncing.missed, 0U);
+    ASSERT_EQ(bouncing.latency_max_us, 0U);
+    ASSERT_EQ(bouncing.duplicates, 6U);
+
+    // Scanning slower than the trace delays the events.
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, TracePins> slow(rows, cols);
+    slow.setup();
+    const TraceReplayReport slower =
+        replay_trace(slow, trace.bytes.data(), trace.bytes.size(), gh::thirtytwobits::TraceReplayOptions{1000, 5000});
+    ASSERT_EQ(slower.scans, 30U);
+    ASSERT_EQ(slower.missed, 0U);
+    ASSERT_GT(slower.latency_max_us, report.latency_max_us);
+
+    // The dimensions must match.
+    const uint8_t                                               one_row[1] = {0};
+    gh::thirtytwobits::SwitchMatrixScanner<1, 3, 10, TracePins> wrong(one_row, cols);
+    ASSERT_FALSE(replay_trace(wrong, trace.bytes.data(), trace.bytes.size()).valid);
+}
+
+TEST(SwitchMatrixTraceReplayTest, SyntheticTrace)
+{
+    TraceBuffer trace;
+    // Five seconds of a press every 60ms held for 30ms with up to 2ms of bounce, sampled every 250us.
+    const gh::thirtytwobits::SyntheticTraceOptions options{20000, 250, 60000, 30000, 2000, 1};
+    gh::thirtytwobits::synthesize_trace<2, 3>(trace, options);
+    using Debounce = gh::thirtytwobits::TimedDebounce<5000, gh::thirtytwobits::TraceClock>;
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, TracePins, Debounce> test_subject(rows, cols);
+    test_subject.setup();
+    const TraceReplayReport report = replay_trace(test_subject, trace.bytes.data(), trace.bytes.size());
+    ASSERT_EQ(report.frames, 20000U);
+    // The last release falls after the end of the trace.
+    ASSERT_EQ(report.reference_edges, 2U * 84U - 1U);
+    ASSERT_EQ(report.missed, 0U);
+    ASSERT_EQ(report.duplicates, 0U);
+    ASSERT_GE(report.latency_p50_us, 5000U);
+
+    // Bounce longer than EagerDebounce's lockout is reported.
+    gh::thirtytwobits::SwitchMatrixScanner<2, 3, 10, TracePins, gh::thirtytwobits::EagerDebounce<>> eager(rows, cols);
+    eager.setup();
+    ASSERT_GT(replay_trace(eager, trace.bytes.data(), trace.bytes.size()).duplicates, 0U);
+}
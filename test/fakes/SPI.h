@@ -0,0 +1,54 @@
+/*
+ * Host stand-in for the Arduino SPI library. Transactions and transferred bytes are appended to SPI.log so
+ * tests can check what a driver sent.
+ */
+#ifndef GH_THIRTYTWOBITS_TEST_FAKES_SPI_H
+#define GH_THIRTYTWOBITS_TEST_FAKES_SPI_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+struct SPISettings
+{
+    SPISettings(const uint32_t clock, const uint8_t bit_order, const uint8_t data_mode)
+        : clock(clock)
+        , bit_order(bit_order)
+        , data_mode(data_mode)
+    {}
+
+    uint32_t clock;
+    uint8_t  bit_order;
+    uint8_t  data_mode;
+};
+
+class FakeSPIClass
+{
+public:
+    void beginTransaction(const SPISettings&)
+    {
+        log += "[ ";
+    }
+
+    uint8_t transfer(const uint8_t data)
+    {
+        char hex[4];
+        snprintf(hex, sizeof(hex), "%02X ", data);
+        log += hex;
+        return 0;
+    }
+
+    void endTransaction()
+    {
+        log += "] ";
+    }
+
+    std::string log;
+};
+
+extern FakeSPIClass SPI;
+
+#endif  // GH_THIRTYTWOBITS_TEST_FAKES_SPI_H
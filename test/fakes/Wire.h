@@ -0,0 +1,70 @@
+/*
+ * Host stand-in for the Arduino Wire library. Bus traffic is appended to Wire.log and reads are served from
+ * Wire.responses.
+ *
+ *      S<address>  beginTransmission         W<byte>  write
+ *      P           endTransmission (stop)    R        endTransmission(false) (repeated start)
+ *      Q<address>,<count>  requestFrom
+ */
+#ifndef GH_THIRTYTWOBITS_TEST_FAKES_WIRE_H
+#define GH_THIRTYTWOBITS_TEST_FAKES_WIRE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+class FakeTwoWire
+{
+public:
+    void beginTransmission(const uint8_t address)
+    {
+        append("S%02X ", address);
+    }
+
+    size_t write(const uint8_t data)
+    {
+        append("W%02X ", data);
+        return 1;
+    }
+
+    uint8_t endTransmission(const bool stop = true)
+    {
+        log += stop ? "P " : "R ";
+        return 0;
+    }
+
+    uint8_t requestFrom(const uint8_t address, const uint8_t quantity)
+    {
+        char entry[16];
+        snprintf(entry, sizeof(entry), "Q%02X,%u ", address, quantity);
+        log += entry;
+        return quantity;
+    }
+
+    int read()
+    {
+        if (responses.empty())
+        {
+            return -1;
+        }
+        const uint8_t data = responses.front();
+        responses.pop_front();
+        return data;
+    }
+
+    std::string         log;
+    std::deque<uint8_t> responses;
+
+private:
+    void append(const char* const format, const uint8_t value)
+    {
+        char entry[8];
+        snprintf(entry, sizeof(entry), format, value);
+        log += entry;
+    }
+};
+
+extern FakeTwoWire Wire;
+
+#endif  // GH_THIRTYTWOBITS_TEST_FAKES_WIRE_H